@@ -195,12 +195,11 @@ static int vt_parser( int fd, Parser::UTF8Parser *parser )
   Parser::Actions actions;
   for ( int i = 0; i < bytes_read; i++ ) {
     parser->input( buf[ i ], actions );
-    for ( Parser::Actions::iterator j = actions.begin();
+    for ( Parser::Actions::const_iterator j = actions.begin();
 	  j != actions.end();
 	  j++ ) {
 
-      Parser::Action *act = *j;
-      assert( act );
+      const Parser::Action *act = &*j;
 
       if ( act->char_present ) {
 	if ( iswprint( act->ch ) ) {
@@ -212,8 +211,6 @@ static int vt_parser( int fd, Parser::UTF8Parser *parser )
 	printf( "[%s] ", act->name().c_str() );
       }
 
-      delete act;
-
       fflush( stdout );
     }
     actions.clear();
@@ -0,0 +1,453 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of portions of this program with the
+    OpenSSL library under certain conditions as described in each
+    individual source file, and distribute linked combinations including
+    the two.
+
+    You must obey the GNU General Public License in all respects for all
+    of the code used other than OpenSSL. If you modify file(s) with this
+    exception, you may extend this exception to your version of the
+    file(s), but you are not obligated to do so. If you do not wish to do
+    so, delete this exception statement from your version. If you delete
+    this exception statement from all source files in the program, then
+    also delete it here.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <exception>
+#include <new>
+
+#include "parser.h"
+#include "terminal.h"
+#include "terminalwidth.h"
+#include "completeterminal.h"
+#include "locale_utils.h"
+#include "fatal_assert.h"
+#include "timestamp.h"
+
+/* Measures the throughput of each stage of the host-output path on
+   synthetic byte streams resembling common terminal workloads, and on
+   recorded streams (e.g. from script(1)) named on the command line:
+
+     utf8      UTF8Parser alone, decoding bytes into actions
+     dispatch  Dispatcher collecting parameters and intermediates
+               (function execution is counted under emulator)
+     emulator  Emulator applying pre-parsed actions one by one
+     complete  Complete::act on pty-sized chunks, as mosh-server does
+
+   Also measures the cost of character width lookups.  "make
+   bench-terminal" runs it with JSON output. */
+
+const size_t DEFAULT_MEGABYTES = 16;
+const size_t WIDTH = 80, HEIGHT = 24;
+const size_t READ_SIZE = 16384; /* as mosh-server reads from the pty */
+
+using std::string;
+using std::vector;
+
+/* Count heap allocations.  Only operator new is replaced; the default
+   operator delete releases memory with free(). */
+static unsigned long long allocations = 0;
+
+void *operator new( size_t size )
+{
+  allocations++;
+  void *p = malloc( size ? size : 1 );
+  if ( p == NULL ) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+static string make_build_log( void )
+{
+  string ret;
+  char line[ 128 ];
+  for ( int i = 0; i < 200; i++ ) {
+    snprintf( line, sizeof line,
+	      "g++ -DHAVE_CONFIG_H -I. -I../.. -O2 -c -o file%03d.o file%03d.cc\r\n", i, i );
+    ret.append( line );
+  }
+  return ret;
+}
+
+static string make_color_log( void )
+{
+  string ret;
+  char line[ 128 ];
+  for ( int i = 0; i < 200; i++ ) {
+    snprintf( line, sizeof line,
+	      "\033[1;3%dm[%5d]\033[0m \033[32mINFO\033[0m request served in \033[33m%d\033[0mms\r\n",
+	      i % 8, i, i * 7 );
+    ret.append( line );
+  }
+  return ret;
+}
+
+static string make_unicode_text( void )
+{
+  string ret;
+  for ( int i = 0; i < 200; i++ ) {
+    ret.append( "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e "     /* Japanese */
+		"\xce\x95\xce\xbb\xce\xbb\xce\xb7\xce\xbd\xce\xb9\xce\xba\xce\xac " /* Greek */
+		"caf\xc3\xa9 na\xc3\xafve \xe2\x94\x80\xe2\x94\x80\xe2\x94\x80\r\n" );
+  }
+  return ret;
+}
+
+/* Full-screen application: an editor redrawing the screen with
+   absolute cursor motion, line numbers, erases and a status line,
+   interleaved with scrolling inside a region. */
+static string make_fullscreen( void )
+{
+  string ret;
+  char line[ 160 ];
+  for ( int frame = 0; frame < 20; frame++ ) {
+    ret.append( "\033[?25l\033[H" );
+    for ( size_t row = 1; row < HEIGHT; row++ ) {
+      snprintf( line, sizeof line,
+		"\033[%lu;1H\033[38;5;244m%4lu \033[m  if ( \033[1;34mcount\033[m > %d ) { return %d; }\033[K",
+		static_cast<unsigned long>( row ),
+		static_cast<unsigned long>( row + frame ), frame, int( row ) );
+      ret.append( line );
+    }
+    snprintf( line, sizeof line,
+	      "\033[%lu;1H\033[7m file.cc  line %d  col 1 \033[m\033[K",
+	      static_cast<unsigned long>( HEIGHT ), frame );
+    ret.append( line );
+    snprintf( line, sizeof line, "\033[2;%lur\033[%lu;1H\nnew line %d\033[r",
+	      static_cast<unsigned long>( HEIGHT - 1 ),
+	      static_cast<unsigned long>( HEIGHT - 1 ), frame );
+    ret.append( line );
+    ret.append( "\033[12;7H\033[?25h" );
+  }
+  return ret;
+}
+
+static string read_file( const char *filename )
+{
+  FILE *f = fopen( filename, "rb" );
+  if ( f == NULL ) {
+    perror( filename );
+    exit( 1 );
+  }
+  string ret;
+  char buf[ 65536 ];
+  size_t n;
+  while ( (n = fread( buf, 1, sizeof buf, f )) > 0 ) {
+    ret.append( buf, n );
+  }
+  if ( ferror( f ) ) {
+    perror( filename );
+    exit( 1 );
+  }
+  fclose( f );
+  if ( ret.empty() ) {
+    fprintf( stderr, "%s: empty file\n", filename );
+    exit( 1 );
+  }
+  return ret;
+}
+
+class Stream {
+public:
+  string name;
+  string bytes;
+  Parser::Actions actions; /* bytes, parsed */
+
+  Stream( const string &s_name, const string &s_bytes )
+    : name( s_name ), bytes( s_bytes ), actions()
+  {
+    Parser::UTF8Parser parser;
+    for ( string::const_iterator i = bytes.begin(); i != bytes.end(); i++ ) {
+      parser.input( *i, actions );
+    }
+  }
+};
+
+class Result {
+public:
+  string stream;
+  string stage;
+  size_t bytes;
+  uint64_t elapsed; /* milliseconds */
+  unsigned long long allocations;
+
+  Result( const string &s_stream, const string &s_stage, size_t s_bytes,
+	  uint64_t s_elapsed, unsigned long long s_allocations )
+    : stream( s_stream ), stage( s_stage ), bytes( s_bytes ),
+      elapsed( s_elapsed ? s_elapsed : 1 ), allocations( s_allocations )
+  {}
+
+  double mb_per_sec( void ) const
+  {
+    return double( bytes ) / ( 1024.0 * 1024.0 ) / ( double( elapsed ) / 1000.0 );
+  }
+  double ns_per_byte( void ) const { return double( elapsed ) * 1e6 / double( bytes ); }
+  double allocs_per_byte( void ) const { return double( allocations ) / double( bytes ); }
+};
+
+/* Each stage function processes the whole stream once. */
+
+static void stage_utf8( const Stream &stream )
+{
+  static Parser::UTF8Parser parser;
+  static Parser::Actions actions;
+  const char *data = stream.bytes.data();
+  const size_t len = stream.bytes.size();
+  for ( size_t i = 0; i < len; ) {
+    i += parser.input( data + i, len - i, actions );
+    actions.clear();
+  }
+}
+
+static void stage_dispatch( const Stream &stream )
+{
+  static Terminal::Dispatcher dispatch;
+  for ( Parser::Actions::const_iterator i = stream.actions.begin();
+	i != stream.actions.end();
+	i++ ) {
+    switch ( i->type ) {
+    case Parser::CLEAR:
+      dispatch.clear( &*i );
+      break;
+    case Parser::PARAM:
+      dispatch.newparamchar( &*i );
+      break;
+    case Parser::COLLECT:
+      dispatch.collect( &*i );
+      break;
+    case Parser::OSC_START:
+      dispatch.OSC_start( &*i );
+      break;
+    case Parser::OSC_PUT:
+      dispatch.OSC_put( &*i );
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+static void stage_emulator( const Stream &stream )
+{
+  static Terminal::Emulator emulator( WIDTH, HEIGHT );
+  for ( Parser::Actions::const_iterator i = stream.actions.begin();
+	i != stream.actions.end();
+	i++ ) {
+    i->act_on_terminal( &emulator );
+  }
+}
+
+static void stage_complete( const Stream &stream )
+{
+  static Terminal::Complete complete( WIDTH, HEIGHT );
+  static vector<string> chunks;
+  static const Stream *chunked = NULL;
+
+  if ( chunked != &stream ) {
+    chunks.clear();
+    for ( size_t i = 0; i < stream.bytes.size(); i += READ_SIZE ) {
+      chunks.push_back( stream.bytes.substr( i, READ_SIZE ) );
+    }
+    chunked = &stream;
+  }
+
+  for ( vector<string>::const_iterator i = chunks.begin(); i != chunks.end(); i++ ) {
+    complete.act( *i );
+  }
+}
+
+static Result run( const Stream &stream, const char *stage,
+		   void (*fn)( const Stream & ), size_t total_bytes )
+{
+  size_t bytes = 0;
+
+  fn( stream ); /* warm up, and allocate any lasting state */
+
+  unsigned long long allocations_before = allocations;
+  freeze_timestamp();
+  uint64_t start = frozen_timestamp();
+
+  while ( bytes < total_bytes ) {
+    fn( stream );
+    bytes += stream.bytes.size();
+  }
+
+  freeze_timestamp();
+  return Result( stream.name, stage, bytes, frozen_timestamp() - start,
+		 allocations - allocations_before );
+}
+
+/* Latin, Greek, box drawing, CJK, emoji and a combining mark */
+static const wchar_t width_sample[] = {
+  0x61, 0xe9, 0x3b5, 0x2500, 0x65e5, 0x672c, 0xac00, 0x1f600, 0x301, 0xff21
+};
+
+template <int (*width)( wchar_t )>
+static double run_width( size_t lookups )
+{
+  const size_t sample_size = sizeof( width_sample ) / sizeof( width_sample[ 0 ] );
+  volatile int sum = 0;
+
+  freeze_timestamp();
+  uint64_t start = frozen_timestamp();
+
+  for ( size_t i = 0, j = 0; i < lookups; i++ ) {
+    sum += width( width_sample[ j ] + static_cast<wchar_t>( i & 0x3 ) );
+    if ( ++j == sample_size ) {
+      j = 0;
+    }
+  }
+
+  freeze_timestamp();
+  uint64_t elapsed = frozen_timestamp() - start;
+  if ( elapsed == 0 ) {
+    elapsed = 1;
+  }
+
+  return double( elapsed ) * 1e6 / double( lookups );
+}
+
+static string json_string( const string &s )
+{
+  string ret( "\"" );
+  for ( string::const_iterator i = s.begin(); i != s.end(); i++ ) {
+    unsigned char c = *i;
+    if ( c == '"' || c == '\\' ) {
+      ret.push_back( '\\' );
+      ret.push_back( c );
+    } else if ( c < 0x20 ) {
+      char esc[ 8 ];
+      snprintf( esc, sizeof esc, "\\u%04x", c );
+      ret.append( esc );
+    } else {
+      ret.push_back( c );
+    }
+  }
+  ret.push_back( '"' );
+  return ret;
+}
+
+static void print_text( const vector<Result> &results, double ns_char_width, double ns_wcwidth )
+{
+  string last_stream;
+  for ( vector<Result>::const_iterator i = results.begin(); i != results.end(); i++ ) {
+    if ( i->stream != last_stream ) {
+      printf( "%s:\n", i->stream.c_str() );
+      last_stream = i->stream;
+    }
+    printf( "  %-10s %8.1f MB/s %8.2f ns/byte %8.4f allocs/byte\n", i->stage.c_str(),
+	    i->mb_per_sec(), i->ns_per_byte(), i->allocs_per_byte() );
+  }
+  printf( "char_width %8.2f ns/char\n", ns_char_width );
+  printf( "wcwidth    %8.2f ns/char\n", ns_wcwidth );
+}
+
+static void print_json( const vector<Result> &results, double ns_char_width, double ns_wcwidth )
+{
+  printf( "{\n  \"version\": %s,\n  \"results\": [\n", json_string( PACKAGE_VERSION ).c_str() );
+  for ( vector<Result>::const_iterator i = results.begin(); i != results.end(); i++ ) {
+    printf( "    { \"stream\": %s, \"stage\": %s, \"bytes\": %lu, \"mb_per_sec\": %.2f, "
+	    "\"ns_per_byte\": %.3f, \"allocs_per_byte\": %.6f }%s\n",
+	    json_string( i->stream ).c_str(), json_string( i->stage ).c_str(),
+	    static_cast<unsigned long>( i->bytes ),
+	    i->mb_per_sec(), i->ns_per_byte(), i->allocs_per_byte(),
+	    i + 1 == results.end() ? "" : "," );
+  }
+  printf( "  ],\n  \"width\": { \"char_width_ns_per_char\": %.3f, \"wcwidth_ns_per_char\": %.3f }\n}\n",
+	  ns_char_width, ns_wcwidth );
+}
+
+static void usage( const char *argv0 )
+{
+  fprintf( stderr, "Usage: %s [-j] [-s MEGABYTES] [RECORDING...]\n", argv0 );
+}
+
+int main( int argc, char **argv )
+{
+  try {
+    size_t megabytes = DEFAULT_MEGABYTES;
+    bool json = false;
+    int opt;
+
+    while ( (opt = getopt( argc, argv, "js:" )) != -1 ) {
+      switch ( opt ) {
+      case 'j':
+	json = true;
+	break;
+      case 's':
+	{
+	  int n = atoi( optarg );
+	  if ( n < 1 || n > 100000 ) {
+	    fprintf( stderr, "bogus size in megabytes\n" );
+	    exit( 1 );
+	  }
+	  megabytes = n;
+	}
+	break;
+      default:
+	usage( argv[ 0 ] );
+	exit( 1 );
+      }
+    }
+
+    /* Adopt native locale */
+    set_native_locale();
+    fatal_assert( is_utf8_locale() );
+
+    vector<Stream> streams;
+    streams.push_back( Stream( "build-log", make_build_log() ) );
+    streams.push_back( Stream( "color-log", make_color_log() ) );
+    streams.push_back( Stream( "unicode", make_unicode_text() ) );
+    streams.push_back( Stream( "fullscreen", make_fullscreen() ) );
+    for ( int i = optind; i < argc; i++ ) {
+      streams.push_back( Stream( argv[ i ], read_file( argv[ i ] ) ) );
+    }
+
+    const size_t total_bytes = megabytes * 1024 * 1024;
+    vector<Result> results;
+    for ( vector<Stream>::const_iterator i = streams.begin(); i != streams.end(); i++ ) {
+      results.push_back( run( *i, "utf8", stage_utf8, total_bytes ) );
+      results.push_back( run( *i, "dispatch", stage_dispatch, total_bytes ) );
+      results.push_back( run( *i, "emulator", stage_emulator, total_bytes ) );
+      results.push_back( run( *i, "complete", stage_complete, total_bytes ) );
+    }
+
+    double ns_char_width = run_width<Terminal::char_width>( total_bytes / 4 );
+    double ns_wcwidth = run_width<wcwidth>( total_bytes / 4 );
+
+    if ( json ) {
+      print_json( results, ns_char_width, ns_wcwidth );
+    } else {
+      print_text( results, ns_char_width, ns_wcwidth );
+    }
+  } catch ( const std::exception &e ) {
+    fprintf( stderr, "Exception caught: %s\n", e.what() );
+    return 1;
+  }
+  return 0;
+}
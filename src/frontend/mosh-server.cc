@@ -47,7 +47,6 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <pwd.h>
-#include <typeinfo>
 #include <signal.h>
 #ifdef HAVE_UTEMPTER
 #include <utempter.h>
@@ -407,6 +406,10 @@ static int run_server( const char *desired_ip, const char *desired_port,
     window_size.ws_row = 24;
   }
 
+  /* the sender keeps up to 32 copies of the screen, which share
+     their equal rows if interned */
+  Terminal::RowPool::set_interning( true );
+
   /* open parser and terminal */
   Terminal::Complete terminal( window_size.ws_col, window_size.ws_row );
 
@@ -626,6 +629,9 @@ static void serve( int host_fd, Terminal::Complete &terminal, ServerConnection &
   sel.add_signal( SIGINT );
   sel.add_signal( SIGUSR1 );
 
+  /* the network takes a snapshot of the terminal whenever it sends */
+  network.set_current_state_source( &terminal );
+
   uint64_t last_remote_num = network.get_remote_state_num();
 
   #ifdef HAVE_UTEMPTER
@@ -699,12 +705,13 @@ static void serve( int host_fd, Terminal::Complete &terminal, ServerConnection &
 	  /* apply userstream to terminal */
 	  for ( size_t i = 0; i < us.size(); i++ ) {
 	    const Parser::Action *action = us.get_action( i );
-	    if ( typeid( *action ) == typeid( Parser::Resize ) ) {
+	    if ( action->type == Parser::RESIZE ) {
 	      /* apply only the last consecutive Resize action */
 	      while ( i < us.size() - 1 &&
-		   typeid( us.get_action( i + 1 ) ) == typeid( Parser::Resize ) ) {
+		   us.get_action( i + 1 )->type == Parser::RESIZE ) {
 		i++;
 	      }
+	      action = us.get_action( i );
 	      /* tell child process of resize */
 	      const Parser::Resize *res = static_cast<const Parser::Resize *>( action );
 	      struct winsize window_size;
@@ -727,11 +734,6 @@ static void serve( int host_fd, Terminal::Complete &terminal, ServerConnection &
 	    terminal.register_input_frame( last_remote_num, now );
 	  }
 
-	  /* update client with new state of terminal */
-	  if ( !network.shutdown_in_progress() ) {
-	    network.set_current_state( terminal );
-	  }
-	  
 	  #ifdef HAVE_UTEMPTER
 	  /* update utmp entry if we have become "connected" */
 	  if ( (!connected_utmp)
@@ -784,9 +786,6 @@ static void serve( int host_fd, Terminal::Complete &terminal, ServerConnection &
 	  network.start_shutdown();
 	} else {
 	  terminal_to_host += terminal.act( string( buf, bytes_read ) );
-	
-	  /* update client with new state of terminal */
-	  network.set_current_state( terminal );
 	}
       }
 
@@ -849,12 +848,8 @@ static void serve( int host_fd, Terminal::Complete &terminal, ServerConnection &
       }
       #endif
 
-      if ( terminal.set_echo_ack( now ) ) {
-	/* update client with new echo ack */
-	if ( !network.shutdown_in_progress() ) {
-	  network.set_current_state( terminal );
-	}
-      }
+      /* the client picks up a new echo ack with the next send */
+      terminal.set_echo_ack( now );
 
       if ( !network.get_remote_state_num()
            && time_since_remote_state >= timeout_if_no_client ) {
@@ -33,10 +33,10 @@
 #include <algorithm>
 #include <wchar.h>
 #include <list>
-#include <typeinfo>
 #include <limits.h>
 
 #include "terminaloverlay.h"
+#include "terminalwidth.h"
 
 using namespace Overlay;
 using std::max;
@@ -267,7 +267,7 @@ void NotificationEngine::apply( Framebuffer &fb ) const
     }
 
     wchar_t ch = *i;
-    int chwidth = ch == L'\0' ? -1 : wcwidth( ch );
+    int chwidth = ch == L'\0' ? -1 : char_width( ch );
     Cell *this_cell = 0;
 
     switch ( chwidth ) {
@@ -669,18 +669,17 @@ void PredictionEngine::new_user_byte( char the_byte, const Framebuffer &fb )
   Parser::Actions actions;
   parser.input( the_byte, actions );
 
-  for ( Parser::Actions::iterator it = actions.begin();
+  for ( Parser::Actions::const_iterator it = actions.begin();
         it != actions.end();
         it++ ) {
-    Parser::Action *act = *it;
+    const Parser::Action *act = &*it;
 
     /*
     fprintf( stderr, "Action: %s (%lc)\n",
 	     act->name().c_str(), act->char_present ? act->ch : L'_' );
     */
 
-    const std::type_info& type_act = typeid( *act );
-    if ( type_act == typeid( Parser::Print ) ) {
+    if ( act->type == Parser::PRINT ) {
       /* make new prediction */
 
       init_cursor( fb );
@@ -727,7 +726,7 @@ void PredictionEngine::new_user_byte( char the_byte, const Framebuffer &fb )
 	    }
 	  }
 	}
-      } else if ( (ch < 0x20) || (wcwidth( ch ) != 1) ) {
+      } else if ( (ch < 0x20) || (char_width( ch ) != 1) ) {
 	/* unknown print */
 	become_tentative();
 	//	fprintf( stderr, "Unknown print 0x%x\n", ch );
@@ -811,7 +810,7 @@ void PredictionEngine::new_user_byte( char the_byte, const Framebuffer &fb )
 	  newline_carriage_return( fb );
 	}
       }
-    } else if ( type_act == typeid( Parser::Execute ) ) {
+    } else if ( act->type == Parser::EXECUTE ) {
       if ( act->char_present && (act->ch == 0x0d) /* CR */ ) {
 	become_tentative();
 	newline_carriage_return( fb );
@@ -819,10 +818,10 @@ void PredictionEngine::new_user_byte( char the_byte, const Framebuffer &fb )
 	//	fprintf( stderr, "Execute 0x%x\n", act->ch );
 	become_tentative();	
       }
-    } else if ( type_act == typeid( Parser::Esc_Dispatch ) ) {
+    } else if ( act->type == Parser::ESC_DISPATCH ) {
       //      fprintf( stderr, "Escape sequence\n" );
       become_tentative();
-    } else if ( type_act == typeid( Parser::CSI_Dispatch ) ) {
+    } else if ( act->type == Parser::CSI_DISPATCH ) {
       if ( act->char_present && (act->ch == L'C') ) { /* right arrow */
 	init_cursor( fb );
 	if ( cursor().col < fb.ds.get_width() - 1 ) {
@@ -841,8 +840,6 @@ void PredictionEngine::new_user_byte( char the_byte, const Framebuffer &fb )
 	become_tentative();
       }
     }
-
-    delete act;
   }
 }
 
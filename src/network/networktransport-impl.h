@@ -138,6 +138,7 @@ void Transport<MyState, RemoteState>::recv( void )
 
     if ( !inst.diff().empty() ) {
       new_state.state.apply_string( inst.diff() );
+      new_state.state.intern();
     }
 
     /* Insert new state in sorted place */
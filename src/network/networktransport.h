@@ -99,6 +99,7 @@ namespace Network {
 
     MyState &get_current_state( void ) { return sender.get_current_state(); }
     void set_current_state( const MyState &x ) { sender.set_current_state( x ); }
+    void set_current_state_source( const MyState *x ) { sender.set_current_state_source( x ); }
 
     uint64_t get_remote_state_num( void ) const { return received_states.back().num; }
 
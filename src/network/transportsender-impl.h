@@ -51,6 +51,8 @@ template <class MyState>
 TransportSender<MyState>::TransportSender( Connection *s_connection, MyState &initial_state )
   : connection( s_connection ), 
     current_state( initial_state ),
+    current_source( NULL ),
+    diff_cache(),
     sent_states( 1, TimestampedState<MyState>( timestamp(), 0, initial_state ) ),
     assumed_receiver_state( sent_states.begin() ),
     fragmenter(),
@@ -83,6 +85,52 @@ unsigned int TransportSender<MyState>::send_interval( void ) const
   return SEND_INTERVAL;
 }
 
+/* Has the source moved on since current_state was copied from it? */
+template <class MyState>
+bool TransportSender<MyState>::current_source_changed( void ) const
+{
+  return current_source
+    && !shutdown_in_progress
+    && current_source->get_version() != current_state.get_version();
+}
+
+/* Bring current_state up to date with its source. Returns true if it changed. */
+template <class MyState>
+bool TransportSender<MyState>::pull_current_state( void )
+{
+  if ( !current_source_changed() ) {
+    return false;
+  }
+
+  current_state = *current_source;
+  current_state.reset_input();
+  return true;
+}
+
+/* target.diff_from( source ), remembered so that resends and the
+   prospective resend check do not serialize the same diff again */
+template <class MyState>
+string TransportSender<MyState>::diff_between( const MyState &target, const MyState &source )
+{
+  const pair<uint64_t, uint64_t> key( target.get_version(), source.get_version() );
+
+  for ( typename diff_cache_type::iterator i = diff_cache.begin();
+	i != diff_cache.end();
+	i++ ) {
+    if ( i->first == key ) {
+      diff_cache.splice( diff_cache.begin(), diff_cache, i );
+      return i->second;
+    }
+  }
+
+  diff_cache.push_front( cached_diff_type( key, target.diff_from( source ) ) );
+  if ( diff_cache.size() > DIFF_CACHE_SIZE ) {
+    diff_cache.pop_back();
+  }
+
+  return diff_cache.front().second;
+}
+
 /* Housekeeping routine to calculate next send and ack times */
 template <class MyState>
 void TransportSender<MyState>::calculate_timers( void )
@@ -99,7 +147,10 @@ void TransportSender<MyState>::calculate_timers( void )
     next_ack_time = now + ACK_DELAY;
   }
 
-  if ( !(current_state == sent_states.back().state) ) {
+  /* a changed source is assumed to differ from the last sent state;
+     tick() checks again once it has taken the snapshot */
+  if ( current_source_changed()
+       || !(current_state == sent_states.back().state) ) {
     if ( mindelay_clock == uint64_t( -1 ) ) {
       mindelay_clock = now;
     }
@@ -166,9 +217,29 @@ void TransportSender<MyState>::tick( void )
     return;
   }
 
+  /* Only now that something is due is the source copied */
+  if ( pull_current_state() ) {
+    /* A source touched without changing did not start a change, so
+       the next real one still waits for SEND_MINDELAY */
+    if ( current_state == sent_states.back().state ) {
+      mindelay_clock = uint64_t( -1 );
+    }
+    calculate_timers();
+
+    if ( (now < next_ack_time)
+	 && (now < next_send_time) ) {
+      return;
+    }
+  }
+
+  /* Interning changes how a diff is drawn, though not what it draws,
+     so do it before the first diff is cached under this version.
+     It does nothing if interning is off or the state is unchanged. */
+  current_state.intern();
+
   /* Determine if a new diff or empty ack needs to be sent */
     
-  string diff = current_state.diff_from( assumed_receiver_state->state );
+  string diff = diff_between( current_state, assumed_receiver_state->state );
 
   attempt_prospective_resend_optimization( diff );
 
@@ -185,6 +256,11 @@ void TransportSender<MyState>::tick( void )
     if ( current_diff != new_diff ) {
       fprintf( stderr, "Warning, target state Instruction verification failed!\n" );
     }
+    /* And that states taken to be equal by their versions really are. */
+    if ( (current_state == sent_states.back().state)
+	 && current_state.compare( sent_states.back().state ) ) {
+      fprintf( stderr, "Warning, state version verification failed!\n" );
+    }
   }
 
   if ( diff.empty() ) {
@@ -228,6 +304,8 @@ void TransportSender<MyState>::send_empty_ack( void )
 template <class MyState>
 void TransportSender<MyState>::add_sent_state( uint64_t the_timestamp, uint64_t num, MyState &state )
 {
+  /* let the kept state share storage with the others */
+  state.intern();
   sent_states.push_back( TimestampedState<MyState>( the_timestamp, num, state ) );
   if ( sent_states.size() > 32 ) { /* limit on state queue */
     typename sent_states_type::iterator last = sent_states.end();
@@ -400,7 +478,7 @@ void TransportSender<MyState>::attempt_prospective_resend_optimization( string &
     return;
   }
 
-  string resend_diff = current_state.diff_from( sent_states.front().state );
+  string resend_diff = diff_between( current_state, sent_states.front().state );
 
   /* We do a prophylactic resend if it would make the diff shorter,
      or if it would lengthen it by no more than 100 bytes and still be
@@ -55,6 +55,7 @@ namespace Network {
   const int ACK_DELAY = 100; /* ms before delayed ack */
   const int SHUTDOWN_RETRIES = 16; /* number of shutdown packets to send before giving up */
   const int ACTIVE_RETRY_TIMEOUT = 10000; /* attempt to resend at frame rate */
+  const unsigned int DIFF_CACHE_SIZE = 8; /* diffs kept for resends */
 
   template <class MyState>
   class TransportSender
@@ -74,6 +75,19 @@ namespace Network {
 
     MyState current_state;
 
+    /* if set, current_state is a copy of *current_source, taken only
+       when a send is due */
+    const MyState *current_source;
+    bool current_source_changed( void ) const;
+    bool pull_current_state( void );
+
+    /* recent diffs, most recent first, by (target, source) version;
+       versions are never reused, so entries cannot go stale */
+    typedef pair< pair<uint64_t, uint64_t>, string > cached_diff_type;
+    typedef list< cached_diff_type > diff_cache_type;
+    diff_cache_type diff_cache;
+    string diff_between( const MyState &target, const MyState &source );
+
     typedef list< TimestampedState<MyState> > sent_states_type;
     sent_states_type sent_states;
     /* first element: known, acknowledged receiver state */
@@ -132,18 +146,20 @@ namespace Network {
     /* Received something */
     void remote_heard( uint64_t ts ) { last_heard = ts; }
 
-    /* Starts shutdown sequence */
-    void start_shutdown( void ) { if ( !shutdown_in_progress ) { shutdown_start = timestamp(); shutdown_in_progress = true; } }
+    /* Starts shutdown sequence, freezing the last state of any source */
+    void start_shutdown( void ) { if ( !shutdown_in_progress ) { pull_current_state(); shutdown_start = timestamp(); shutdown_in_progress = true; } }
 
     /* Misc. getters and setters */
     /* Cannot modify current_state while shutdown in progress */
-    MyState &get_current_state( void ) { assert( !shutdown_in_progress ); return current_state; }
+    MyState &get_current_state( void ) { assert( !shutdown_in_progress ); pull_current_state(); return current_state; }
     void set_current_state( const MyState &x )
     {
       assert( !shutdown_in_progress );
       current_state = x;
       current_state.reset_input();
     }
+    /* Follow x instead of being handed copies; x must outlive the sender */
+    void set_current_state_source( const MyState *x ) { current_source = x; }
     void set_verbose( unsigned int s_verbose ) { verbose = s_verbose; }
 
     bool get_shutdown_in_progress( void ) const { return shutdown_in_progress; }
@@ -36,25 +36,49 @@
 #include "hostinput.pb.h"
 
 #include <limits.h>
+#include <algorithm>
 
 using namespace std;
 using namespace Parser;
 using namespace Terminal;
 using namespace HostBuffers;
 
+const size_t Complete::MAX_PARSE_SPAN;
+
+uint64_t Complete::new_version( void )
+{
+  static uint64_t version_counter = 0;
+  return ++version_counter;
+}
+
 string Complete::act( const string &str )
 {
-  for ( unsigned int i = 0; i < str.size(); i++ ) {
-    /* parse octet into up to three actions */
-    parser.input( str[ i ], actions );
-    
-    /* apply actions to terminal and delete them */
-    for ( Actions::iterator it = actions.begin();
+  version = new_version();
+
+  const char *data = str.data();
+  const size_t len = str.size();
+
+  size_t i = 0;
+  while ( i < len ) {
+    /* print runs of printable ASCII directly, bypassing the parser */
+    if ( parser.in_ground() ) {
+      size_t run = Parser::printable_ascii_run( data + i, len - i );
+      if ( run > 0 ) {
+	terminal.print_ascii_run( data + i, run );
+	i += run;
+	continue;
+      }
+    }
+
+    /* parse everything else up to the next such run, a bounded
+       span at a time so the action list stays small */
+    i += parser.input( data + i, min( len - i, MAX_PARSE_SPAN ), actions );
+
+    /* apply actions to terminal */
+    for ( Actions::const_iterator it = actions.begin();
 	  it != actions.end();
 	  it++ ) {
-      Action *act = *it;
-      act->act_on_terminal( &terminal );
-      delete act;
+      it->act_on_terminal( &terminal );
     }
     actions.clear();
   }
@@ -64,6 +88,8 @@ string Complete::act( const string &str )
 
 string Complete::act( const Action *act )
 {
+  version = new_version();
+
   /* apply action to terminal */
   act->act_on_terminal( &terminal );
   return terminal.read_octets_to_host();
@@ -119,12 +145,19 @@ void Complete::apply_string( const string & diff )
       uint64_t inst_echo_ack_num = input.instruction( i ).GetExtension( echoack ).echo_ack_num();
       assert( inst_echo_ack_num >= echo_ack );
       echo_ack = inst_echo_ack_num;
+      version = new_version();
     }
   }
 }
 
 bool Complete::operator==( Complete const &x ) const
 {
+  /* versions are never reused, so a copy that has not been touched
+     since is equal without a look at the framebuffer */
+  if ( version == x.version ) {
+    return true;
+  }
+
   //  assert( parser == x.parser ); /* parser state is irrelevant for us */
   return (terminal == x.terminal) && (echo_ack == x.echo_ack);
 }
@@ -151,6 +184,7 @@ bool Complete::set_echo_ack( uint64_t now )
 
   if ( echo_ack != newest_echo_ack ) {
     ret = true;
+    version = new_version();
   }
 
   echo_ack = newest_echo_ack;
@@ -49,19 +49,30 @@ namespace Terminal {
     Terminal::Display display;
 
     // Only used locally by act(), but kept here as a performance optimization,
-    // to avoid construction/destruction.  It must always be empty
-    // outside calls to act() to keep horrible things from happening.
+    // so that its storage is reused and parsing does not allocate.  It must
+    // always be empty outside calls to act() to keep horrible things from happening.
     Parser::Actions actions;
 
     typedef std::list< std::pair<uint64_t, uint64_t> > input_history_type;
     input_history_type input_history;
     uint64_t echo_ack;
 
+    // Changes whenever the terminal may have changed, so that a copy can
+    // tell cheaply whether it is stale.  Copies keep the version; a
+    // version is never handed out twice, so equal versions mean equal
+    // terminals.
+    uint64_t version;
+    static uint64_t new_version( void );
+
+    uint64_t interned_version; /* version when the rows were last interned */
+
     static const int ECHO_TIMEOUT = 50; /* for late ack */
+    static const size_t MAX_PARSE_SPAN = 4096; /* octets parsed per batch of actions */
 
   public:
     Complete( size_t width, size_t height ) : parser(), terminal( width, height ), display( false ),
-					      actions(), input_history(), echo_ack( 0 ) {}
+					      actions(), input_history(), echo_ack( 0 ),
+					      version( new_version() ), interned_version( 0 ) {}
     
     std::string act( const std::string &str );
     std::string act( const Parser::Action *act );
@@ -72,9 +83,18 @@ namespace Terminal {
     bool set_echo_ack( uint64_t now );
     void register_input_frame( uint64_t n, uint64_t now );
     int wait_time( uint64_t now ) const;
+    uint64_t get_version( void ) const { return version; }
 
     /* interface for Network::Transport */
     void subtract( const Complete * ) const {}
+    void intern( void )
+    {
+      /* the rows are already interned unless the terminal changed since */
+      if ( interned_version != version ) {
+	terminal.intern_rows();
+	interned_version = version;
+      }
+    }
     std::string diff_from( const Complete &existing ) const;
     std::string init_diff( void ) const;
     void apply_string( const std::string & diff );
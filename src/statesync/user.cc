@@ -31,7 +31,6 @@
 */
 
 #include <assert.h>
-#include <typeinfo>
 
 #include "user.h"
 #include "fatal_assert.h"
@@ -41,8 +40,19 @@ using namespace Parser;
 using namespace Network;
 using namespace ClientBuffers;
 
+uint64_t UserStream::new_version( void )
+{
+  static uint64_t version_counter = 0;
+  return ++version_counter;
+}
+
 void UserStream::subtract( const UserStream *prefix )
 {
+  if ( prefix->actions.empty() ) {
+    return;
+  }
+  version = new_version();
+
   // if we are subtracting ourself from ourself, just clear the deque
   if ( this == prefix ) {
     actions.clear();
@@ -109,6 +119,7 @@ void UserStream::apply_string( const string &diff )
 {
   ClientBuffers::UserMessage input;
   fatal_assert( input.ParseFromString( diff ) );
+  version = new_version();
 
   for ( int i = 0; i < input.instruction_size(); i++ ) {
     if ( input.instruction( i ).HasExtension( keystroke ) ) {
@@ -37,6 +37,7 @@
 #include <list>
 #include <string>
 #include <assert.h>
+#include <stdint.h>
 
 #include "parseraction.h"
 
@@ -75,19 +76,24 @@ namespace Network {
   {
   private:
     deque<UserEvent> actions;
+    uint64_t version; /* changes on every change, never reused */
+    static uint64_t new_version( void );
     
   public:
-    UserStream() : actions() {}
+    UserStream() : actions(), version( new_version() ) {}
     
-    void push_back( const Parser::UserByte & s_userbyte ) { actions.push_back( UserEvent( s_userbyte ) ); }
-    void push_back( const Parser::Resize & s_resize ) { actions.push_back( UserEvent( s_resize ) ); }
+    void push_back( const Parser::UserByte & s_userbyte ) { actions.push_back( UserEvent( s_userbyte ) ); version = new_version(); }
+    void push_back( const Parser::Resize & s_resize ) { actions.push_back( UserEvent( s_resize ) ); version = new_version(); }
     
     bool empty( void ) const { return actions.empty(); }
     size_t size( void ) const { return actions.size(); }
     const Parser::Action *get_action( unsigned int i ) const;
+    uint64_t get_version( void ) const { return version; }
     
     /* interface for Network::Transport */
     void subtract( const UserStream *prefix );
+    void intern( void ) {}
+    void reset_input( void ) {}
     string diff_from( const UserStream &existing ) const;
     string init_diff( void ) const { assert( false ); return string(); };
     void apply_string( const string &diff );
@@ -0,0 +1,124 @@
+#!/usr/bin/perl
+
+# Generate terminalwidthtable.cc, the character width table used by
+# Terminal::char_width(), from the Unicode Character Database that
+# ships with perl:
+#
+#   perl genwidthtable.pl > terminalwidthtable.cc
+#
+# Widths follow the rules glibc uses to build its wcwidth() table:
+#
+#   -1  controls other than NUL, line and paragraph separators,
+#       surrogates and unassigned code points
+#    0  NUL, nonspacing and enclosing marks, format characters other
+#       than SOFT HYPHEN and prepended concatenation marks, ZERO WIDTH
+#       SPACE, and Hangul medial vowels and final consonants
+#    2  East Asian Wide and Fullwidth characters, plus the circled
+#       numbers on black squares and the Yijing hexagram symbols
+#    1  everything else
+#
+# The table is two-level: code points are split into blocks of 256, and
+# identical blocks are stored once.  Each entry is two bits holding
+# width + 1.
+
+use strict;
+use warnings;
+use Unicode::UCD qw(prop_invmap prop_invlist);
+
+my $MAX = 0x110000;
+my $BLOCK = 256;
+
+sub expand {
+    my ( $prop ) = @_;
+    my ( $list, $map ) = prop_invmap( $prop );
+    my @values;
+    for my $i ( 0 .. $#$list ) {
+	my $end = $i < $#$list ? $list->[ $i + 1 ] : $MAX;
+	for ( my $cp = $list->[ $i ]; $cp < $end && $cp < $MAX; $cp++ ) {
+	    $values[ $cp ] = $map->[ $i ];
+	}
+    }
+    return \@values;
+}
+
+my $gc = expand( 'General_Category' );
+my $ea = expand( 'East_Asian_Width' );
+
+my %prepended;
+my @pcm = prop_invlist( 'Prepended_Concatenation_Mark' );
+for ( my $i = 0; $i < @pcm; $i += 2 ) {
+    $prepended{ $_ } = 1 for $pcm[ $i ] .. $pcm[ $i + 1 ] - 1;
+}
+
+my @width;
+for my $cp ( 0 .. $MAX - 1 ) {
+    my $cat = $gc->[ $cp ];
+    my $w;
+    if ( $cp == 0 ) {
+	$w = 0;
+    } elsif ( $cat =~ /^(Cc|Cs|Cn|Zl|Zp)$/ ) {
+	$w = -1;
+    } elsif ( $cat eq 'Mn' || $cat eq 'Me'
+	      || ( $cat eq 'Cf' && $cp != 0xAD && !$prepended{ $cp } )
+	      || $cp == 0x200B
+	      || ( $cp >= 0x1160 && $cp <= 0x11FF )
+	      || ( $cp >= 0xD7B0 && $cp <= 0xD7FF ) ) {
+	$w = 0;
+    } elsif ( $ea->[ $cp ] =~ /^(W|Wide|F|Fullwidth)$/
+	      || ( $cp >= 0x3248 && $cp <= 0x324F )
+	      || ( $cp >= 0x4DC0 && $cp <= 0x4DFF ) ) {
+	$w = 2;
+    } else {
+	$w = 1;
+    }
+    push @width, $w;
+}
+
+my ( @blocks, %block_number, @index );
+for ( my $base = 0; $base < $MAX; $base += $BLOCK ) {
+    my @bytes;
+    for ( my $i = 0; $i < $BLOCK; $i += 4 ) {
+	my $byte = 0;
+	for my $j ( 0 .. 3 ) {
+	    $byte |= ( $width[ $base + $i + $j ] + 1 ) << ( 2 * $j );
+	}
+	push @bytes, $byte;
+    }
+    my $key = join ',', @bytes;
+    if ( !exists $block_number{ $key } ) {
+	$block_number{ $key } = scalar @blocks;
+	push @blocks, \@bytes;
+    }
+    push @index, $block_number{ $key };
+}
+
+die "too many distinct blocks for an 8-bit index\n" if @blocks > 256;
+
+my $version = Unicode::UCD::UnicodeVersion();
+
+print <<"EOF";
+/* Generated by genwidthtable.pl from Unicode $version data.  Do not edit. */
+
+#include "terminalwidth.h"
+
+namespace Terminal {
+  const unsigned char char_width_index[ CHAR_WIDTH_INDEX_SIZE ] = {
+EOF
+
+for ( my $i = 0; $i < @index; $i += 16 ) {
+    my $end = $i + 15 < $#index ? $i + 15 : $#index;
+    print "    ", join( ', ', @index[ $i .. $end ] ), ",\n";
+}
+
+print "  };\n\n";
+printf "  const unsigned char char_width_blocks[ %d ][ CHAR_WIDTH_BLOCK_BYTES ] = {\n", scalar @blocks;
+
+for my $block ( @blocks ) {
+    print "    {\n";
+    for ( my $i = 0; $i < @$block; $i += 16 ) {
+	print "      ", join( ', ', map { sprintf '0x%02x', $_ } @$block[ $i .. $i + 15 ] ), ",\n";
+    }
+    print "    },\n";
+}
+
+print "  };\n}\n";
@@ -30,132 +30,192 @@
     also delete it here.
 */
 
-#include <assert.h>
-#include <typeinfo>
-#include <errno.h>
+#include "config.h"
+
 #include <wchar.h>
 #include <stdint.h>
 
+#if HAVE_DECL___BUILTIN_CTZ
+#if __SSE2__
+#include <immintrin.h>
+#elif __ARM_NEON && __aarch64__
+#include <arm_neon.h>
+#endif
+#endif
+
 #include "parser.h"
 
 const Parser::StateFamily Parser::family;
 
-static void append_or_delete( Parser::Action *act,
-			      Parser::Actions &vec )
+void Parser::Parser::append( ActionType type, Actions &ret ) const
 {
-  assert( act );
+  if ( type != IGNORE ) {
+    ret.push_back( Action( type ) );
+  }
+}
 
-  if ( !act->ignore() ) {
-    vec.push_back( act );
-  } else {
-    delete act;
+void Parser::Parser::append( ActionType type, wchar_t ch, Actions &ret ) const
+{
+  if ( type != IGNORE ) {
+    ret.push_back( Action( type, ch ) );
   }
 }
 
 void Parser::Parser::input( wchar_t ch, Actions &ret )
 {
-  Transition tx = state->input( ch );
+  const StateFamily::TableEntry &tx = family.table[ state ][ StateFamily::input_class( ch ) ];
 
-  if ( tx.next_state != NULL ) {
-    append_or_delete( state->exit(), ret );
+  if ( tx.next_state != StateFamily::NO_TRANSITION ) {
+    append( static_cast<ActionType>( family.exit_action[ state ] ), ret );
   }
 
-  append_or_delete( tx.action, ret );
-  tx.action = NULL;
+  append( static_cast<ActionType>( tx.action ), ch, ret );
 
-  if ( tx.next_state != NULL ) {
-    append_or_delete( tx.next_state->enter(), ret );
+  if ( tx.next_state != StateFamily::NO_TRANSITION ) {
+    append( static_cast<ActionType>( family.enter_action[ tx.next_state ] ), ret );
     state = tx.next_state;
   }
 }
 
 Parser::UTF8Parser::UTF8Parser()
-  : parser(), buf_len( 0 )
+  : parser(), partial( 0 ), partial_min( 0 ), pending( 0 )
+{}
+
+/* Begin a new character with the byte c. */
+void Parser::UTF8Parser::start( unsigned char c, Actions &ret )
 {
-  assert( BUF_SIZE >= (size_t)MB_CUR_MAX );
-  buf[0] = '\0';
+  if ( c <= 0x7f ) {
+    parser.input( static_cast<wchar_t>( c ), ret );
+  } else if ( c >= 0xc2 && c <= 0xdf ) {
+    partial = c & 0x1f;
+    partial_min = 0x80;
+    pending = 1;
+  } else if ( c >= 0xe0 && c <= 0xef ) {
+    partial = c & 0x0f;
+    partial_min = 0x800;
+    pending = 2;
+  } else if ( c >= 0xf0 && c <= 0xf7 ) {
+    partial = c & 0x07;
+    partial_min = 0x10000;
+    pending = 3;
+  } else if ( c >= 0xf8 && c <= 0xfb ) {
+    /* obsolete 5- and 6-byte forms are decoded, then
+       rejected as outside the Unicode range */
+    partial = c & 0x03;
+    partial_min = 0x200000;
+    pending = 4;
+  } else if ( c >= 0xfc && c <= 0xfd ) {
+    partial = c & 0x01;
+    partial_min = 0x4000000;
+    pending = 5;
+  } else {
+    /* continuation byte without a leader, C0, C1, FE or FF */
+    parser.input( (wchar_t) 0xFFFD, ret );
+  }
+}
+
+/* Hand a completely accumulated character to the parser. */
+void Parser::UTF8Parser::finish( Actions &ret )
+{
+  if ( (partial < partial_min)
+       || ((partial >= 0xD800) && (partial <= 0xDFFF)) ) {
+    /* overlong or surrogate: the leading bytes and the final
+       byte are each replaced */
+    parser.input( (wchar_t) 0xFFFD, ret );
+    parser.input( (wchar_t) 0xFFFD, ret );
+  } else if ( partial > 0x10FFFF ) { /* outside Unicode range */
+    parser.input( (wchar_t) 0xFFFD, ret );
+  } else {
+    parser.input( static_cast<wchar_t>( partial ), ret );
+  }
 }
 
 void Parser::UTF8Parser::input( char c, Actions &ret )
 {
-  assert( buf_len < BUF_SIZE );
+  const unsigned char b = c;
 
-  /* 1-byte UTF-8 character, aka ASCII?  Cheat. */
-  if ( buf_len == 0 && static_cast<unsigned char>(c) <= 0x7f ) {
-    parser.input( static_cast<wchar_t>(c), ret );
+  if ( pending == 0 ) {
+    start( b, ret );
     return;
   }
 
-  buf[ buf_len++ ] = c;
-
-  /* This function will only work in a UTF-8 locale. */
-  wchar_t pwc;
-  mbstate_t ps = mbstate_t();
-
-  size_t total_bytes_parsed = 0;
-  size_t orig_buf_len = buf_len;
-
-  /* this routine is somewhat complicated in order to comply with
-     Unicode 6.0, section 3.9, "Best Practices for using U+FFFD" */
-
-  while ( total_bytes_parsed != orig_buf_len ) {
-    assert( total_bytes_parsed < orig_buf_len );
-    assert( buf_len > 0 );
-    size_t bytes_parsed = mbrtowc( &pwc, buf, buf_len, &ps );
-
-    /* this returns 0 when n = 0! */
-
-    if ( bytes_parsed == 0 ) {
-      /* character was NUL, accept and clear buffer */
-      assert( buf_len == 1 );
-      buf_len = 0;
-      pwc = L'\0';
-      bytes_parsed = 1;
-    } else if ( bytes_parsed == (size_t) -1 ) {
-      /* invalid sequence, use replacement character and try again with last char */
-      assert( errno == EILSEQ );
-      if ( buf_len > 1 ) {
-	buf[ 0 ] = buf[ buf_len - 1 ];
-	bytes_parsed = buf_len - 1;
-	buf_len = 1;
-      } else {
-	buf_len = 0;
-	bytes_parsed = 1;
-      }
-      pwc = (wchar_t) 0xFFFD;
-    } else if ( bytes_parsed == (size_t) -2 ) {
-      /* can't parse incomplete multibyte character */
-      total_bytes_parsed += buf_len;
-      continue;
-    } else {
-      /* parsed into pwc, accept */
-      assert( bytes_parsed <= buf_len );
-      memmove( buf, buf + bytes_parsed, buf_len - bytes_parsed );
-      buf_len = buf_len - bytes_parsed;
-    }
+  if ( (b & 0xc0) != 0x80 ) {
+    /* sequence was cut short: replace it, then start over with this byte */
+    pending = 0;
+    parser.input( (wchar_t) 0xFFFD, ret );
+    start( b, ret );
+    return;
+  }
 
-    /* Cast to unsigned for checks, because some
-       platforms (e.g. ARM) use uint32_t as wchar_t,
-       causing compiler warning on "pwc > 0" check. */
-    const uint32_t pwcheck = pwc;
+  partial = (partial << 6) | (b & 0x3f);
+  if ( --pending == 0 ) {
+    finish( ret );
+  }
+}
 
-    if ( pwcheck > 0x10FFFF ) { /* outside Unicode range */
-      pwc = (wchar_t) 0xFFFD;
-    }
+static inline bool continuation( unsigned char c )
+{
+  return (c & 0xc0) == 0x80;
+}
+
+size_t Parser::UTF8Parser::input( const char *s, size_t len, Actions &ret )
+{
+  const unsigned char *p = reinterpret_cast<const unsigned char *>( s );
+  size_t i = 0;
+
+  while ( i < len ) {
+    const unsigned char b = p[ i ];
 
-    if ( (pwcheck >= 0xD800) && (pwcheck <= 0xDFFF) ) { /* surrogate code point */
-      /*
-	OS X unfortunately allows these sequences without EILSEQ, but
-	they are ill-formed UTF-8 and we shouldn't repeat them to the
-	user's terminal.
-      */
-      pwc = (wchar_t) 0xFFFD;
+    if ( i > 0 && b >= 0x20 && b <= 0x7e && in_ground() ) {
+      break;
     }
 
-    parser.input( pwc, ret );
+    /* Decode complete, well-formed characters straight from the
+       buffer.  Anything else goes through the byte-at-a-time path,
+       which also carries partial characters across calls. */
+    if ( pending == 0 ) {
+      if ( b <= 0x7f ) {
+	parser.input( static_cast<wchar_t>( b ), ret );
+	i++;
+	continue;
+      }
+
+      if ( b >= 0xc2 && b <= 0xdf && i + 1 < len && continuation( p[ i + 1 ] ) ) {
+	const uint32_t c = ((b & 0x1f) << 6) | (p[ i + 1 ] & 0x3f);
+	parser.input( static_cast<wchar_t>( c ), ret );
+	i += 2;
+	continue;
+      }
+
+      if ( b >= 0xe0 && b <= 0xef && i + 2 < len
+	   && continuation( p[ i + 1 ] ) && continuation( p[ i + 2 ] ) ) {
+	const uint32_t c = ((b & 0x0f) << 12) | ((p[ i + 1 ] & 0x3f) << 6)
+	  | (p[ i + 2 ] & 0x3f);
+	if ( c >= 0x800 && (c < 0xD800 || c > 0xDFFF) ) {
+	  parser.input( static_cast<wchar_t>( c ), ret );
+	  i += 3;
+	  continue;
+	}
+      }
 
-    total_bytes_parsed += bytes_parsed;
+      if ( b >= 0xf0 && b <= 0xf4 && i + 3 < len
+	   && continuation( p[ i + 1 ] ) && continuation( p[ i + 2 ] )
+	   && continuation( p[ i + 3 ] ) ) {
+	const uint32_t c = ((b & 0x07) << 18) | ((p[ i + 1 ] & 0x3f) << 12)
+	  | ((p[ i + 2 ] & 0x3f) << 6) | (p[ i + 3 ] & 0x3f);
+	if ( c >= 0x10000 && c <= 0x10FFFF ) {
+	  parser.input( static_cast<wchar_t>( c ), ret );
+	  i += 4;
+	  continue;
+	}
+      }
+    }
+
+    input( static_cast<char>( b ), ret );
+    i++;
   }
+
+  return i;
 }
 
 Parser::Parser::Parser( const Parser &other )
@@ -167,3 +227,57 @@ Parser::Parser & Parser::Parser::operator=( const Parser &other )
   state = other.state;
   return *this;
 }
+
+size_t Parser::printable_ascii_run( const char *s, size_t len )
+{
+  size_t i = 0;
+
+#if HAVE_DECL___BUILTIN_CTZ
+#if __AVX2__
+  const __m256i below = _mm256_set1_epi8( 0x1F );
+  const __m256i above = _mm256_set1_epi8( 0x7F );
+  for ( ; i + 32 <= len; i += 32 ) {
+    /* signed compare, so bytes >= 0x80 also fail the first test */
+    __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( s + i ) );
+    __m256i ok = _mm256_and_si256( _mm256_cmpgt_epi8( v, below ),
+				   _mm256_cmpgt_epi8( above, v ) );
+    unsigned int stop = ~static_cast<unsigned int>( _mm256_movemask_epi8( ok ) );
+    if ( stop ) {
+      return i + __builtin_ctz( stop );
+    }
+  }
+#endif
+#if __SSE2__
+  const __m128i below16 = _mm_set1_epi8( 0x1F );
+  const __m128i above16 = _mm_set1_epi8( 0x7F );
+  for ( ; i + 16 <= len; i += 16 ) {
+    __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( s + i ) );
+    __m128i ok = _mm_and_si128( _mm_cmpgt_epi8( v, below16 ),
+				_mm_cmpgt_epi8( above16, v ) );
+    unsigned int stop = 0xFFFF & ~static_cast<unsigned int>( _mm_movemask_epi8( ok ) );
+    if ( stop ) {
+      return i + __builtin_ctz( stop );
+    }
+  }
+#elif __ARM_NEON && __aarch64__
+  const uint8x16_t first = vdupq_n_u8( 0x20 );
+  const uint8x16_t last = vdupq_n_u8( 0x7E );
+  for ( ; i + 16 <= len; i += 16 ) {
+    uint8x16_t v = vld1q_u8( reinterpret_cast<const uint8_t *>( s + i ) );
+    uint8x16_t ok = vandq_u8( vcgeq_u8( v, first ), vcleq_u8( v, last ) );
+    if ( vminvq_u8( ok ) == 0 ) {
+      break; /* the scalar loop finds the exact position */
+    }
+  }
+#endif
+#endif
+
+  for ( ; i < len; i++ ) {
+    const unsigned char c = s[ i ];
+    if ( c < 0x20 || c > 0x7E ) {
+      break;
+    }
+  }
+
+  return i;
+}
@@ -38,6 +38,7 @@
 
 #include <wchar.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "parsertransition.h"
 #include "parseraction.h"
@@ -49,10 +50,13 @@ namespace Parser {
 
   class Parser {
   private:
-    State const *state;
+    unsigned char state; /* index into family.table */
+
+    void append( ActionType type, Actions &actions ) const;
+    void append( ActionType type, wchar_t ch, Actions &actions ) const;
 
   public:
-    Parser() : state( &family.s_Ground ) {}
+    Parser() : state( StateFamily::GROUND ) {}
 
     Parser( const Parser &other );
     Parser & operator=( const Parser & );
@@ -62,32 +66,55 @@ namespace Parser {
 
     void reset_input( void )
     {
-      state = &family.s_Ground;
+      state = StateFamily::GROUND;
     }
 
+    bool in_ground( void ) const { return state == StateFamily::GROUND; }
   };
 
-  static const size_t BUF_SIZE = 8;
+  /* Locale-independent UTF-8 decoder in front of the parser.
 
+     Ill-formed input is replaced with U+FFFD following the same
+     rules mosh has always used (those of glibc's mbrtowc): a
+     truncated sequence yields one U+FFFD and the interrupting byte
+     is decoded afresh, and a complete sequence that is overlong or
+     encodes a surrogate yields one U+FFFD for its leading bytes and
+     another for its final byte. */
   class UTF8Parser {
   private:
     Parser parser;
 
-    char buf[ BUF_SIZE ];
-    size_t buf_len;
+    uint32_t partial;     /* bits decoded so far */
+    uint32_t partial_min; /* smallest code point needing this length */
+    unsigned int pending; /* continuation bytes still expected */
+
+    void start( unsigned char c, Actions &actions );
+    void finish( Actions &actions );
 
   public:
     UTF8Parser();
 
     void input( char c, Actions &actions );
 
+    /* Decode and parse bytes from s, stopping early (after at least
+       one byte) where printable ASCII follows in Ground, so callers
+       can take the bulk print path.  Returns bytes consumed. */
+    size_t input( const char *s, size_t len, Actions &actions );
+
     void reset_input( void )
     {
       parser.reset_input();
-      buf[0] = '\0';
-      buf_len = 0;
+      partial = partial_min = 0;
+      pending = 0;
     }
+
+    /* True if printable ASCII would be parsed into plain Print
+       actions, i.e. we are in Ground with no partial character. */
+    bool in_ground( void ) const { return pending == 0 && parser.in_ground(); }
   };
+
+  /* Length of the run of printable ASCII (0x20-0x7E) at the start of s. */
+  size_t printable_ascii_run( const char *s, size_t len );
 }
 
 #endif
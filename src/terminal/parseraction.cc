@@ -30,6 +30,7 @@
     also delete it here.
 */
 
+#include <assert.h>
 #include <stdio.h>
 #include <wctype.h>
 
@@ -38,7 +39,7 @@
 
 using namespace Parser;
 
-std::string Action::str( void )
+std::string Action::str( void ) const
 {
   char thechar[ 10 ] = { 0 };
   if ( char_present ) {
@@ -51,69 +52,73 @@ std::string Action::str( void )
   return name() + std::string( thechar );
 }
 
-void Print::act_on_terminal( Terminal::Emulator *emu ) const
+std::string Action::name( void ) const
 {
-  emu->print( this );
+  static const char * const names[] = {
+    "Ignore", "Print", "Execute", "Clear", "Collect", "Param",
+    "Esc_Dispatch", "CSI_Dispatch", "Hook", "Put", "Unhook",
+    "OSC_Start", "OSC_Put", "OSC_End",
+    "UserByte", "Resize"
+  };
+
+  assert( static_cast<size_t>( type ) < sizeof( names ) / sizeof( names[ 0 ] ) );
+  return std::string( names[ type ] );
 }
 
-void Execute::act_on_terminal( Terminal::Emulator *emu ) const
+void Action::act_on_terminal( Terminal::Emulator *emu ) const
 {
-  emu->execute( this );
-}
-
-void Clear::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->dispatch.clear( this );
-}
-
-void Param::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->dispatch.newparamchar( this );
-}
-
-void Collect::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->dispatch.collect( this );
-}
-
-void CSI_Dispatch::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->CSI_dispatch( this );
-}
-
-void Esc_Dispatch::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->Esc_dispatch( this );
-}
-
-void OSC_Put::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->dispatch.OSC_put( this );
-}
-
-void OSC_Start::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->dispatch.OSC_start( this );
-}
-
-void OSC_End::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->OSC_end( this );
-}
-
-void UserByte::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->dispatch.terminal_to_host.append( emu->user.input( this,
-							  emu->fb.ds.application_mode_cursor_keys ) );
-}
-
-void Resize::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->resize( width, height );
+  switch ( type ) {
+  case PRINT:
+    emu->print( this );
+    break;
+  case EXECUTE:
+    emu->execute( this );
+    break;
+  case CLEAR:
+    emu->dispatch.clear( this );
+    break;
+  case PARAM:
+    emu->dispatch.newparamchar( this );
+    break;
+  case COLLECT:
+    emu->dispatch.collect( this );
+    break;
+  case CSI_DISPATCH:
+    emu->CSI_dispatch( this );
+    break;
+  case ESC_DISPATCH:
+    emu->Esc_dispatch( this );
+    break;
+  case OSC_PUT:
+    emu->dispatch.OSC_put( this );
+    break;
+  case OSC_START:
+    emu->dispatch.OSC_start( this );
+    break;
+  case OSC_END:
+    emu->OSC_end( this );
+    break;
+  case USER_BYTE:
+    emu->dispatch.terminal_to_host.append( emu->user.input( static_cast<const UserByte *>( this ),
+							    emu->fb.ds.application_mode_cursor_keys ) );
+    break;
+  case RESIZE:
+    {
+      const Resize *res = static_cast<const Resize *>( this );
+      emu->resize( res->width, res->height );
+    }
+    break;
+  case IGNORE:
+  case HOOK:
+  case PUT:
+  case UNHOOK:
+    break;
+  }
 }
 
 bool Action::operator==( const Action &other ) const
 {
-  return ( char_present == other.char_present )
+  return ( type == other.type )
+    && ( char_present == other.char_present )
     && ( ch == other.ch );
 }
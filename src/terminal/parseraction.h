@@ -41,102 +41,49 @@ namespace Terminal {
 }
 
 namespace Parser {
+  /* Actions produced by the host-source state machine, and
+     the two user-source events */
+  enum ActionType {
+    IGNORE, PRINT, EXECUTE, CLEAR, COLLECT, PARAM,
+    ESC_DISPATCH, CSI_DISPATCH, HOOK, PUT, UNHOOK,
+    OSC_START, OSC_PUT, OSC_END,
+    USER_BYTE, RESIZE
+  };
+
+  /* An Action is a small tagged value.  The parser appends them to a
+     caller-supplied vector, which can be reused from one input
+     character to the next without allocating. */
   class Action
   {
   public:
+    ActionType type;
     wchar_t ch;
     bool char_present;
 
-    std::string str( void );
+    std::string str( void ) const;
 
-    virtual std::string name( void ) = 0;
+    std::string name( void ) const;
 
-    virtual void act_on_terminal( Terminal::Emulator * ) const {};
+    void act_on_terminal( Terminal::Emulator * ) const;
 
-    virtual bool ignore() const { return false; }
+    bool ignore() const { return type == IGNORE; }
 
-    Action() : ch( -1 ), char_present( false ) {};
-    virtual ~Action() {};
+    Action( ActionType s_type = IGNORE )
+      : type( s_type ), ch( -1 ), char_present( false ) {};
+    Action( ActionType s_type, wchar_t s_ch )
+      : type( s_type ), ch( s_ch ), char_present( true ) {};
 
-    virtual bool operator==( const Action &other ) const;
+    bool operator==( const Action &other ) const;
   };
 
-  typedef std::vector<Action *> Actions;
-
-  class Ignore : public Action {
-  public:
-    std::string name( void ) { return std::string( "Ignore" ); }
-    bool ignore() const { return true; }
-  };
-  class Print : public Action {
-  public:
-    std::string name( void ) { return std::string( "Print" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class Execute : public Action {
-  public:
-    std::string name( void ) { return std::string( "Execute" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class Clear : public Action {
-  public:
-    std::string name( void ) { return std::string( "Clear" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class Collect : public Action {
-  public:
-    std::string name( void ) { return std::string( "Collect" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class Param : public Action {
-  public:
-    std::string name( void ) { return std::string( "Param" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class Esc_Dispatch : public Action {
-  public:
-    std::string name( void ) { return std::string( "Esc_Dispatch" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class CSI_Dispatch : public Action {
-  public:
-    std::string name( void ) { return std::string( "CSI_Dispatch" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class Hook : public Action {
-  public: std::string name( void ) { return std::string( "Hook" ); }
-  };
-  class Put : public Action {
-  public: std::string name( void ) { return std::string( "Put" ); }
-  };
-  class Unhook : public Action {
-  public: std::string name( void ) { return std::string( "Unhook" ); }
-  };
-  class OSC_Start : public Action {
-  public:
-    std::string name( void ) { return std::string( "OSC_Start" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class OSC_Put : public Action {
-  public:
-    std::string name( void ) { return std::string( "OSC_Put" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class OSC_End : public Action {
-  public:
-    std::string name( void ) { return std::string( "OSC_End" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
+  typedef std::vector<Action> Actions;
 
   class UserByte : public Action {
     /* user keystroke -- not part of the host-source state machine*/
   public:
     char c; /* The user-source byte. We don't try to interpret the charset */
 
-    std::string name( void ) { return std::string( "UserByte" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-
-    UserByte( int s_c ) : c( s_c ) {}
+    UserByte( int s_c ) : Action( USER_BYTE ), c( s_c ) {}
 
     bool operator==( const UserByte &other ) const
     {
@@ -149,11 +96,9 @@ namespace Parser {
   public:
     size_t width, height;
 
-    std::string name( void ) { return std::string( "Resize" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-
     Resize( size_t s_width, size_t s_height )
-      : width( s_width ),
+      : Action( RESIZE ),
+	width( s_width ),
 	height( s_height )
     {}
 
@@ -30,6 +30,8 @@
     also delete it here.
 */
 
+#include <assert.h>
+
 #include "parserstate.h"
 #include "parserstatefamily.h"
 
@@ -41,7 +43,7 @@ Transition State::anywhere_rule( wchar_t ch ) const
        || ((0x80 <= ch) && (ch <= 0x8F))
        || ((0x91 <= ch) && (ch <= 0x97))
        || (ch == 0x99) || (ch == 0x9A) ) {
-    return Transition( new Execute, &family->s_Ground );
+    return Transition( EXECUTE, &family->s_Ground );
   } else if ( ch == 0x9C ) {
     return Transition( &family->s_Ground );
   } else if ( ch == 0x1B ) {
@@ -56,7 +58,7 @@ Transition State::anywhere_rule( wchar_t ch ) const
     return Transition( &family->s_CSI_Entry );
   }
 
-  return Transition(( State * )NULL, NULL ); /* don't allocate an Ignore action */
+  return Transition();
 }
 
 Transition State::input( wchar_t ch ) const
@@ -64,16 +66,11 @@ Transition State::input( wchar_t ch ) const
   /* Check for immediate transitions. */
   Transition anywhere = anywhere_rule( ch );
   if ( anywhere.next_state ) {
-    anywhere.action->char_present = true;
-    anywhere.action->ch = ch;
     return anywhere;
   }
   /* Normal X.364 state machine. */
   /* Parse high Unicode codepoints like 'A'. */
-  Transition ret = this->input_state_rule( ch >= 0xA0 ? 0x41 : ch );
-  ret.action->char_present = true;
-  ret.action->ch = ch;
-  return ret;
+  return this->input_state_rule( ch >= 0xA0 ? 0x41 : ch );
 }
 
 static bool C0_prime( wchar_t ch )
@@ -92,29 +89,29 @@ static bool GLGR ( wchar_t ch )
 Transition Ground::input_state_rule( wchar_t ch ) const
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( GLGR( ch ) ) {
-    return Transition( new Print );
+    return Transition( PRINT );
   }
 
   return Transition();
 }
 
-Action *Escape::enter( void ) const
+ActionType Escape::enter( void ) const
 {
-  return new Clear;
+  return CLEAR;
 }
 
 Transition Escape::input_state_rule( wchar_t ch ) const
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect, &family->s_Escape_Intermediate );
+    return Transition( COLLECT, &family->s_Escape_Intermediate );
   }
 
   if ( ( (0x30 <= ch) && (ch <= 0x4F) )
@@ -123,7 +120,7 @@ Transition Escape::input_state_rule( wchar_t ch ) const
        || ( ch == 0x5A )
        || ( ch == 0x5C )
        || ( (0x60 <= ch) && (ch <= 0x7E) ) ) {
-    return Transition( new Esc_Dispatch, &family->s_Ground );
+    return Transition( ESC_DISPATCH, &family->s_Ground );
   }
 
   if ( ch == 0x5B ) {
@@ -148,50 +145,46 @@ Transition Escape::input_state_rule( wchar_t ch ) const
 Transition Escape_Intermediate::input_state_rule( wchar_t ch ) const
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect );
+    return Transition( COLLECT );
   }
 
   if ( (0x30 <= ch) && (ch <= 0x7E) ) {
-    return Transition( new Esc_Dispatch, &family->s_Ground );
+    return Transition( ESC_DISPATCH, &family->s_Ground );
   }
 
   return Transition();
 }
 
-Action *CSI_Entry::enter( void ) const
+ActionType CSI_Entry::enter( void ) const
 {
-  return new Clear;
+  return CLEAR;
 }
 
 Transition CSI_Entry::input_state_rule( wchar_t ch ) const
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
-    return Transition( new CSI_Dispatch, &family->s_Ground );
+    return Transition( CSI_DISPATCH, &family->s_Ground );
   }
 
-  if ( ( (0x30 <= ch) && (ch <= 0x39) )
-       || ( ch == 0x3B ) ) {
-    return Transition( new Param, &family->s_CSI_Param );
+  /* 0x3A is the sub-parameter separator, as in SGR 38:2:r:g:b */
+  if ( (0x30 <= ch) && (ch <= 0x3B) ) {
+    return Transition( PARAM, &family->s_CSI_Param );
   }
 
   if ( (0x3C <= ch) && (ch <= 0x3F) ) {
-    return Transition( new Collect, &family->s_CSI_Param );
-  }
-
-  if ( ch == 0x3A ) {
-    return Transition( &family->s_CSI_Ignore );
+    return Transition( COLLECT, &family->s_CSI_Param );
   }
 
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect, &family->s_CSI_Intermediate );
+    return Transition( COLLECT, &family->s_CSI_Intermediate );
   }
 
   return Transition();
@@ -200,23 +193,23 @@ Transition CSI_Entry::input_state_rule( wchar_t ch ) const
 Transition CSI_Param::input_state_rule( wchar_t ch ) const
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
-  if ( ( (0x30 <= ch) && (ch <= 0x39) ) || ( ch == 0x3B ) ) {
-    return Transition( new Param );
+  if ( (0x30 <= ch) && (ch <= 0x3B) ) {
+    return Transition( PARAM );
   }
 
-  if ( ( ch == 0x3A ) || ( (0x3C <= ch) && (ch <= 0x3F) ) ) {
+  if ( (0x3C <= ch) && (ch <= 0x3F) ) {
     return Transition( &family->s_CSI_Ignore );
   }
 
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect, &family->s_CSI_Intermediate );
+    return Transition( COLLECT, &family->s_CSI_Intermediate );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
-    return Transition( new CSI_Dispatch, &family->s_Ground );
+    return Transition( CSI_DISPATCH, &family->s_Ground );
   }
 
   return Transition();
@@ -225,15 +218,15 @@ Transition CSI_Param::input_state_rule( wchar_t ch ) const
 Transition CSI_Intermediate::input_state_rule( wchar_t ch ) const
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect );
+    return Transition( COLLECT );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
-    return Transition( new CSI_Dispatch, &family->s_Ground );
+    return Transition( CSI_DISPATCH, &family->s_Ground );
   }
 
   if ( (0x30 <= ch) && (ch <= 0x3F) ) {
@@ -246,7 +239,7 @@ Transition CSI_Intermediate::input_state_rule( wchar_t ch ) const
 Transition CSI_Ignore::input_state_rule( wchar_t ch ) const
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
@@ -256,15 +249,15 @@ Transition CSI_Ignore::input_state_rule( wchar_t ch ) const
   return Transition();
 }
 
-Action *DCS_Entry::enter( void ) const
+ActionType DCS_Entry::enter( void ) const
 {
-  return new Clear;
+  return CLEAR;
 }
 
 Transition DCS_Entry::input_state_rule( wchar_t ch ) const
 {
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect, &family->s_DCS_Intermediate );
+    return Transition( COLLECT, &family->s_DCS_Intermediate );
   }
 
   if ( ch == 0x3A ) {
@@ -272,11 +265,11 @@ Transition DCS_Entry::input_state_rule( wchar_t ch ) const
   }
 
   if ( ( (0x30 <= ch) && (ch <= 0x39) ) || ( ch == 0x3B ) ) {
-    return Transition( new Param, &family->s_DCS_Param );
+    return Transition( PARAM, &family->s_DCS_Param );
   }
 
   if ( (0x3C <= ch) && (ch <= 0x3F) ) {
-    return Transition( new Collect, &family->s_DCS_Param );
+    return Transition( COLLECT, &family->s_DCS_Param );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
@@ -289,7 +282,7 @@ Transition DCS_Entry::input_state_rule( wchar_t ch ) const
 Transition DCS_Param::input_state_rule( wchar_t ch ) const
 {
   if ( ( (0x30 <= ch) && (ch <= 0x39) ) || ( ch == 0x3B ) ) {
-    return Transition( new Param );
+    return Transition( PARAM );
   }
 
   if ( ( ch == 0x3A ) || ( (0x3C <= ch) && (ch <= 0x3F) ) ) {
@@ -297,7 +290,7 @@ Transition DCS_Param::input_state_rule( wchar_t ch ) const
   }
 
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect, &family->s_DCS_Intermediate );
+    return Transition( COLLECT, &family->s_DCS_Intermediate );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
@@ -310,7 +303,7 @@ Transition DCS_Param::input_state_rule( wchar_t ch ) const
 Transition DCS_Intermediate::input_state_rule( wchar_t ch ) const
 {
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect );
+    return Transition( COLLECT );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
@@ -324,20 +317,20 @@ Transition DCS_Intermediate::input_state_rule( wchar_t ch ) const
   return Transition();
 }
 
-Action *DCS_Passthrough::enter( void ) const
+ActionType DCS_Passthrough::enter( void ) const
 {
-  return new Hook;
+  return HOOK;
 }
 
-Action *DCS_Passthrough::exit( void ) const
+ActionType DCS_Passthrough::exit( void ) const
 {
-  return new Unhook;
+  return UNHOOK;
 }
 
 Transition DCS_Passthrough::input_state_rule( wchar_t ch ) const
 {
   if ( C0_prime( ch ) || ( (0x20 <= ch) && (ch <= 0x7E) ) ) {
-    return Transition( new Put );
+    return Transition( PUT );
   }
 
   if ( ch == 0x9C ) {
@@ -356,20 +349,20 @@ Transition DCS_Ignore::input_state_rule( wchar_t ch ) const
   return Transition();
 }
 
-Action *OSC_String::enter( void ) const
+ActionType OSC_String::enter( void ) const
 {
-  return new OSC_Start;
+  return OSC_START;
 }
 
-Action *OSC_String::exit( void ) const
+ActionType OSC_String::exit( void ) const
 {
-  return new OSC_End;
+  return OSC_END;
 }
 
 Transition OSC_String::input_state_rule( wchar_t ch ) const
 {
   if ( (0x20 <= ch) && (ch <= 0x7F) ) {
-    return Transition( new OSC_Put );
+    return Transition( OSC_PUT );
   }
 
   if ( (ch == 0x9C) || (ch == 0x07) ) { /* 0x07 is xterm non-ANSI variant */
@@ -387,3 +380,40 @@ Transition SOS_PM_APC_String::input_state_rule( wchar_t ch ) const
 
   return Transition();
 }
+
+StateFamily::StateFamily()
+  : s_Ground(), s_Escape(), s_Escape_Intermediate(),
+    s_CSI_Entry(), s_CSI_Param(), s_CSI_Intermediate(), s_CSI_Ignore(),
+    s_DCS_Entry(), s_DCS_Param(), s_DCS_Intermediate(),
+    s_DCS_Passthrough(), s_DCS_Ignore(),
+    s_OSC_String(), s_SOS_PM_APC_String()
+{
+  build_table();
+}
+
+void StateFamily::build_table( void )
+{
+  State *states[ NUM_STATES ] = {
+    &s_Ground, &s_Escape, &s_Escape_Intermediate,
+    &s_CSI_Entry, &s_CSI_Param, &s_CSI_Intermediate, &s_CSI_Ignore,
+    &s_DCS_Entry, &s_DCS_Param, &s_DCS_Intermediate,
+    &s_DCS_Passthrough, &s_DCS_Ignore,
+    &s_OSC_String, &s_SOS_PM_APC_String
+  };
+
+  for ( unsigned char i = 0; i < NUM_STATES; i++ ) {
+    states[ i ]->setfamily( this, i );
+  }
+  assert( states[ GROUND ] == &s_Ground );
+
+  for ( unsigned char i = 0; i < NUM_STATES; i++ ) {
+    enter_action[ i ] = states[ i ]->enter();
+    exit_action[ i ] = states[ i ]->exit();
+
+    for ( unsigned int ch = 0; ch < NUM_CLASSES; ch++ ) {
+      Transition tx = states[ i ]->input( ch );
+      table[ i ][ ch ].action = tx.action;
+      table[ i ][ ch ].next_state = tx.next_state ? tx.next_state->get_index() : NO_TRANSITION;
+    }
+  }
+}
@@ -46,14 +46,22 @@ namespace Parser {
 
   private:
     Transition anywhere_rule( wchar_t ch ) const;
+    unsigned char index;
 
   public:
-    void setfamily( StateFamily *s_family ) { family = s_family; }
+    void setfamily( StateFamily *s_family, unsigned char s_index )
+    {
+      family = s_family;
+      index = s_index;
+    }
+    unsigned char get_index( void ) const { return index; }
+
+    /* Only used to build the transition table; see StateFamily. */
     Transition input( wchar_t ch ) const;
-    virtual Action *enter( void ) const { return new Ignore; }
-    virtual Action *exit( void ) const { return new Ignore; }
+    virtual ActionType enter( void ) const { return IGNORE; }
+    virtual ActionType exit( void ) const { return IGNORE; }
 
-    State() : family( NULL ) {};
+    State() : family( NULL ), index( 0 ) {};
     virtual ~State() {};
 
     State( const State & );
@@ -65,7 +73,7 @@ namespace Parser {
   };
 
   class Escape : public State {
-    Action *enter( void ) const;
+    ActionType enter( void ) const;
     Transition input_state_rule( wchar_t ch ) const;
   };
 
@@ -74,7 +82,7 @@ namespace Parser {
   };
 
   class CSI_Entry : public State {
-    Action *enter( void ) const;
+    ActionType enter( void ) const;
     Transition input_state_rule( wchar_t ch ) const;
   };
   class CSI_Param : public State {
@@ -88,7 +96,7 @@ namespace Parser {
   };
   
   class DCS_Entry : public State {
-    Action *enter( void ) const;
+    ActionType enter( void ) const;
     Transition input_state_rule( wchar_t ch ) const;
   };
   class DCS_Param : public State {
@@ -98,18 +106,18 @@ namespace Parser {
     Transition input_state_rule( wchar_t ch ) const;
   };
   class DCS_Passthrough : public State {
-    Action *enter( void ) const;
+    ActionType enter( void ) const;
     Transition input_state_rule( wchar_t ch ) const;
-    Action *exit( void ) const;
+    ActionType exit( void ) const;
   };
   class DCS_Ignore : public State {
     Transition input_state_rule( wchar_t ch ) const;
   };
 
   class OSC_String : public State {
-    Action *enter( void ) const;
+    ActionType enter( void ) const;
     Transition input_state_rule( wchar_t ch ) const;
-    Action *exit( void ) const;
+    ActionType exit( void ) const;
   };
   class SOS_PM_APC_String : public State {
     Transition input_state_rule( wchar_t ch ) const;
@@ -33,9 +33,15 @@
 #ifndef PARSERSTATEFAMILY_HPP
 #define PARSERSTATEFAMILY_HPP
 
+#include <stdint.h>
+
 #include "parserstate.h"
 
 namespace Parser {
+  /* The states of the parser, and a transition table built from
+     their rules.  The table maps (state, input class) to an action
+     and a next state, so the parser never has to call into the
+     State objects while parsing. */
   class StateFamily
   {
   public:
@@ -58,28 +64,34 @@ namespace Parser {
     OSC_String s_OSC_String;
     SOS_PM_APC_String s_SOS_PM_APC_String;
 
-    StateFamily()
-      : s_Ground(), s_Escape(), s_Escape_Intermediate(),
-	s_CSI_Entry(), s_CSI_Param(), s_CSI_Intermediate(), s_CSI_Ignore(),
-	s_DCS_Entry(), s_DCS_Param(), s_DCS_Intermediate(),
-	s_DCS_Passthrough(), s_DCS_Ignore(),
-	s_OSC_String(), s_SOS_PM_APC_String()
+    static const unsigned char NUM_STATES = 14;
+    static const unsigned char NO_TRANSITION = NUM_STATES;
+    static const unsigned char GROUND = 0; /* index of s_Ground */
+
+    /* One input class per C0, GL and C1 character.  Everything from
+       0xA0 up is parsed like 'A', and shares its class. */
+    static const unsigned int NUM_CLASSES = 0xA0;
+
+    static unsigned int input_class( wchar_t ch )
     {
-      s_Ground.setfamily( this );
-      s_Escape.setfamily( this );
-      s_Escape_Intermediate.setfamily( this );
-      s_CSI_Entry.setfamily( this );
-      s_CSI_Param.setfamily( this );
-      s_CSI_Intermediate.setfamily( this );
-      s_CSI_Ignore.setfamily( this );
-      s_DCS_Entry.setfamily( this );
-      s_DCS_Param.setfamily( this );
-      s_DCS_Intermediate.setfamily( this );
-      s_DCS_Passthrough.setfamily( this );
-      s_DCS_Ignore.setfamily( this );
-      s_OSC_String.setfamily( this );
-      s_SOS_PM_APC_String.setfamily( this );
+      const uint32_t c = ch;
+      return c < NUM_CLASSES ? c : 0x41;
     }
+
+    class TableEntry {
+    public:
+      unsigned char action; /* ActionType */
+      unsigned char next_state; /* state index, or NO_TRANSITION */
+    };
+
+    TableEntry table[ NUM_STATES ][ NUM_CLASSES ];
+    unsigned char enter_action[ NUM_STATES ];
+    unsigned char exit_action[ NUM_STATES ];
+
+    StateFamily();
+
+  private:
+    void build_table( void );
   };
 }
 
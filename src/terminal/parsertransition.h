@@ -40,38 +40,21 @@
 namespace Parser {
   class State;
 
+  /* A Transition is a plain value: the type of action to take on the
+     input character, and the state to move to (if any).  It is only
+     used to describe the state machine when the transition table is
+     built; it never owns an Action. */
   class Transition
   {
   public:
-    // Transition is only a courier for an Action; it should
-    // never create/delete one on its own.
-    Action *action;
+    ActionType action;
     State *next_state;
 
-    Transition( const Transition &x )
-      : action( x.action ),
-	next_state( x.next_state ) {}
-    Transition & operator=( const Transition &t )
-    {
-      action = t.action;
-      next_state = t.next_state;
-
-      return *this;
-    }
-    virtual ~Transition()
-    {
-      // Indicate to checkers that we don't own *action anymore
-      action = NULL;
-    }
-
-    Transition( Action *s_action=new Ignore, State *s_next_state=NULL )
+    Transition( ActionType s_action=IGNORE, State *s_next_state=NULL )
       : action( s_action ), next_state( s_next_state )
     {}
 
-    // This is only ever used in the 1-argument form;
-    // we use this instead of an initializer to
-    // tell Coverity the object never owns *action.
-    Transition( State *s_next_state, Action *s_action=new Ignore )
+    Transition( State *s_next_state, ActionType s_action=IGNORE )
       : action( s_action ), next_state( s_next_state )
     {}
   };
@@ -34,9 +34,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <typeinfo>
+#include <algorithm>
 
 #include "terminal.h"
+#include "terminalwidth.h"
 
 using namespace Terminal;
 
@@ -51,22 +52,18 @@ std::string Emulator::read_octets_to_host( void )
   return ret;
 }
 
-void Emulator::execute( const Parser::Execute *act )
+void Emulator::execute( const Parser::Action *act )
 {
   dispatch.dispatch( CONTROL, act, &fb );
 }
 
-void Emulator::print( const Parser::Print *act )
+void Emulator::print( const Parser::Action *act )
 {
   assert( act->char_present );
 
   const wchar_t ch = act->ch;
 
-  /*
-   * Check for printing ISO 8859-1 first, it's a cheap way to detect
-   * some common narrow characters.
-   */
-  const int chwidth = ch == L'\0' ? -1 : ( Cell::isprint_iso8859_1( ch ) ? 1 : wcwidth( ch ));
+  const int chwidth = ch == L'\0' ? -1 : char_width( ch );
 
   Cell *this_cell = fb.get_mutable_cell();
 
@@ -74,7 +71,7 @@ void Emulator::print( const Parser::Print *act )
   case 1: /* normal character */
   case 2: /* wide character */
     if ( fb.ds.auto_wrap_mode && fb.ds.next_print_will_wrap ) {
-      fb.get_mutable_row( -1 )->set_wrap( true );
+      fb.set_wrap( -1, true );
       fb.ds.move_col( 0 );
       fb.move_rows_autoscroll( 1 );
       this_cell = NULL;
@@ -83,7 +80,7 @@ void Emulator::print( const Parser::Print *act )
 		&& (fb.ds.get_cursor_col() == fb.ds.get_width() - 1) ) {
       /* wrap 2-cell chars if no room, even without will-wrap flag */
       fb.reset_cell( this_cell );
-      fb.get_mutable_row( -1 )->set_wrap( false );
+      fb.set_wrap( -1, false );
       /* There doesn't seem to be a consistent way to get the
 	 downstream terminal emulator to set the wrap-around
 	 copy-and-paste flag on a row that ends with an empty cell
@@ -148,23 +145,74 @@ void Emulator::print( const Parser::Print *act )
   }
 }
 
-void Emulator::CSI_dispatch( const Parser::CSI_Dispatch *act )
+void Emulator::print_ascii_run( const char *s, size_t len )
+{
+  if ( fb.ds.insert_mode ) {
+    for ( size_t i = 0; i < len; i++ ) {
+      Parser::Action act( Parser::PRINT, static_cast<unsigned char>( s[ i ] ) );
+      print( &act );
+    }
+    return;
+  }
+
+  const int width = fb.ds.get_width();
+
+  /* fill the cursor row up to the margin, then wrap, like print() */
+  while ( len > 0 ) {
+    if ( (fb.ds.get_cursor_row() < fb.ds.limit_top())
+	 || (fb.ds.get_cursor_row() > fb.ds.limit_bottom()) ) {
+      /* cursor is outside the origin-mode region and will snap
+	 back into it after the first character */
+      Parser::Action act( Parser::PRINT, static_cast<unsigned char>( *s ) );
+      print( &act );
+      s++;
+      len--;
+      continue;
+    }
+
+    if ( fb.ds.auto_wrap_mode && fb.ds.next_print_will_wrap ) {
+      fb.set_wrap( -1, true );
+      fb.ds.move_col( 0 );
+      fb.move_rows_autoscroll( 1 );
+    }
+
+    const int col = fb.ds.get_cursor_col();
+    const size_t count = std::min( len, static_cast<size_t>( width - col ) );
+    Row *row = fb.get_mutable_row( -1, col, col + count );
+
+    for ( size_t i = 0; i < count; i++ ) {
+      Cell *cell = &row->cells.at( col + i );
+      fb.reset_cell( cell );
+      cell->append( static_cast<unsigned char>( s[ i ] ) );
+      fb.apply_renditions_to_cell( cell );
+    }
+
+    /* leave the last printed cell as the combining character cell */
+    fb.ds.move_col( col + count - 1 );
+    fb.ds.move_col( 1, true, true );
+
+    s += count;
+    len -= count;
+  }
+}
+
+void Emulator::CSI_dispatch( const Parser::Action *act )
 {
   dispatch.dispatch( CSI, act, &fb );
 }
 
-void Emulator::OSC_end( const Parser::OSC_End *act )
+void Emulator::OSC_end( const Parser::Action *act )
 {
   dispatch.OSC_dispatch( act, &fb );
 }
 
-void Emulator::Esc_dispatch( const Parser::Esc_Dispatch *act )
+void Emulator::Esc_dispatch( const Parser::Action *act )
 {
   /* handle 7-bit ESC-encoding of C1 control characters */
   if ( (dispatch.get_dispatch_chars().size() == 0)
        && (0x40 <= act->ch)
        && (act->ch <= 0x5F) ) {
-    Parser::Esc_Dispatch act2 = *act;
+    Parser::Action act2 = *act;
     act2.ch += 0x40;
     dispatch.dispatch( CONTROL, &act2, &fb );
   } else {
@@ -46,19 +46,7 @@
 
 namespace Terminal {
   class Emulator {
-    friend void Parser::Print::act_on_terminal( Emulator * ) const;
-    friend void Parser::Execute::act_on_terminal( Emulator * ) const;
-    friend void Parser::Clear::act_on_terminal( Emulator * ) const;
-    friend void Parser::Param::act_on_terminal( Emulator * ) const;
-    friend void Parser::Collect::act_on_terminal( Emulator * ) const;
-    friend void Parser::CSI_Dispatch::act_on_terminal( Emulator * ) const;
-    friend void Parser::Esc_Dispatch::act_on_terminal( Emulator * ) const;
-    friend void Parser::OSC_Start::act_on_terminal( Emulator * ) const;
-    friend void Parser::OSC_Put::act_on_terminal( Emulator * ) const;
-    friend void Parser::OSC_End::act_on_terminal( Emulator * ) const;
-
-    friend void Parser::UserByte::act_on_terminal( Emulator * ) const;
-    friend void Parser::Resize::act_on_terminal( Emulator * ) const;
+    friend void Parser::Action::act_on_terminal( Emulator * ) const;
 
   private:
     Framebuffer fb;
@@ -66,11 +54,11 @@ namespace Terminal {
     UserInput user;
 
     /* action methods */
-    void print( const Parser::Print *act );
-    void execute( const Parser::Execute *act );
-    void CSI_dispatch( const Parser::CSI_Dispatch *act );
-    void Esc_dispatch( const Parser::Esc_Dispatch *act );
-    void OSC_end( const Parser::OSC_End *act );
+    void print( const Parser::Action *act );
+    void execute( const Parser::Action *act );
+    void CSI_dispatch( const Parser::Action *act );
+    void Esc_dispatch( const Parser::Action *act );
+    void OSC_end( const Parser::Action *act );
     void resize( size_t s_width, size_t s_height );
 
   public:
@@ -78,7 +66,11 @@ namespace Terminal {
 
     std::string read_octets_to_host( void );
 
+    /* Same as a Print action for each character of a run of printable ASCII */
+    void print_ascii_run( const char *s, size_t len );
+
     const Framebuffer & get_fb( void ) const { return fb; }
+    void intern_rows( void ) { fb.intern_rows(); }
 
     bool operator==( Emulator const &x ) const;
   };
@@ -33,8 +33,9 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
-#include <errno.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <stdint.h>
 
 #include "terminaldispatcher.h"
 #include "parseraction.h"
@@ -43,101 +44,73 @@
 using namespace Terminal;
 
 Dispatcher::Dispatcher()
-  : params(), parsed_params(), parsed( false ), dispatch_chars(),
+  : param_values(), param_is_sub(), num_params( 1 ), has_subparams( false ),
+    dispatch_chars(),
     OSC_string(), terminal_to_host()
-{}
-
-void Dispatcher::newparamchar( const Parser::Param *act )
 {
-  assert( act->char_present );
-  assert( (act->ch == ';') || ( (act->ch >= '0') && (act->ch <= '9') ) );
-  if ( params.length() < 100 ) {
-    /* enough for 16 five-char params plus 15 semicolons */
-    params.push_back( act->ch );
-  }
-  parsed = false;
+  param_values[ 0 ] = -1;
 }
 
-void Dispatcher::collect( const Parser::Collect *act )
+void Dispatcher::newparamchar( const Parser::Action *act )
 {
   assert( act->char_present );
-  if ( ( dispatch_chars.length() < 8 ) /* never should need more than 2 */
-       && ( act->ch <= 255 ) ) {  /* ignore non-8-bit */    
-    dispatch_chars.push_back( act->ch );
-  }
-}
-
-void Dispatcher::clear( const Parser::Clear *act __attribute((unused)) )
-{
-  params.clear();
-  dispatch_chars.clear();
-  parsed = false;
-}
-
-void Dispatcher::parse_params( void )
-{
-  if ( parsed ) {
-    return;
-  }
+  const wchar_t ch = act->ch;
+  assert( (ch == ';') || (ch == ':') || ( (ch >= '0') && (ch <= '9') ) );
 
-  parsed_params.clear();
-  const char *str = params.c_str();
-  const char *segment_begin = str;
-
-  while ( 1 ) {
-    const char *segment_end = strchr( segment_begin, ';' );
-    if ( segment_end == NULL ) {
-      break;
+  if ( (ch == ';') || (ch == ':') ) {
+    if ( ch == ':' ) {
+      has_subparams = true;
     }
-
-    errno = 0;
-    char *endptr;
-    long val = strtol( segment_begin, &endptr, 10 );
-    if ( endptr == segment_begin ) {
-      val = -1;
+    if ( num_params < MAX_PARAMS ) {
+      param_values[ num_params ] = -1;
+      param_is_sub[ num_params ] = (ch == ':');
     }
-
-    if ( val > PARAM_MAX || errno == ERANGE ) {
-      val = -1;
-      errno = 0;
-    }
-
-    if ( errno == 0 || segment_begin == endptr ) {
-      parsed_params.push_back( val );
+    if ( num_params <= MAX_PARAMS ) {
+      num_params++;
     }
-
-    segment_begin = segment_end + 1;
+    return;
   }
 
-  /* get last param */
-  errno = 0;
-  char *endptr;
-  long val = strtol( segment_begin, &endptr, 10 );
-  if ( endptr == segment_begin ) {
-    val = -1;
+  if ( num_params > MAX_PARAMS ) {
+    return; /* dropped */
   }
 
-  if ( val > PARAM_MAX || errno == ERANGE ) {
-    val = -1;
-    errno = 0;
+  int &val = param_values[ num_params - 1 ];
+  if ( val < 0 ) {
+    val = 0;
+  }
+  if ( val <= PARAM_MAX ) {
+    val = val * 10 + (ch - '0');
+  }
+  if ( val > PARAM_MAX ) {
+    val = PARAM_MAX + 1;
   }
+}
 
-  if ( errno == 0 || segment_begin == endptr ) {
-    parsed_params.push_back( val );
+void Dispatcher::collect( const Parser::Action *act )
+{
+  assert( act->char_present );
+  if ( ( dispatch_chars.length() < 8 ) /* never should need more than 2 */
+       && ( act->ch <= 255 ) ) {  /* ignore non-8-bit */    
+    dispatch_chars.push_back( act->ch );
   }
+}
 
-  parsed = true;
+void Dispatcher::clear( const Parser::Action *act __attribute((unused)) )
+{
+  param_values[ 0 ] = -1;
+  param_is_sub[ 0 ] = false;
+  num_params = 1;
+  has_subparams = false;
+  dispatch_chars.clear();
 }
 
-int Dispatcher::getparam( size_t N, int defaultval )
+int Dispatcher::getparam( size_t N, int defaultval ) const
 {
   int ret = defaultval;
-  if ( !parsed ) {
-    parse_params();
-  }
 
-  if ( parsed_params.size() > N ) {
-    ret = parsed_params[ N ];
+  if ( (int)N < param_count() && param_values[ N ] <= PARAM_MAX ) {
+    ret = param_values[ N ];
   }
 
   if ( ret < 1 ) ret = defaultval;
@@ -145,17 +118,20 @@ int Dispatcher::getparam( size_t N, int defaultval )
   return ret;
 }
 
-int Dispatcher::param_count( void )
+std::string Dispatcher::str( void )
 {
-  if ( !parsed ) {
-    parse_params();
+  std::string params;
+  char num[ 16 ];
+  for ( int i = 0; i < param_count(); i++ ) {
+    if ( i > 0 ) {
+      params.push_back( param_is_sub[ i ] ? ':' : ';' );
+    }
+    if ( param_values[ i ] >= 0 ) {
+      snprintf( num, sizeof num, "%d", param_values[ i ] );
+      params.append( num );
+    }
   }
 
-  return parsed_params.size();
-}
-
-std::string Dispatcher::str( void )
-{
   char assum[ 64 ];
   snprintf( assum, 64, "[dispatch=\"%s\" params=\"%s\"]",
 	    dispatch_chars.c_str(), params.c_str() );
@@ -169,21 +145,49 @@ DispatchRegistry & Terminal::get_global_dispatch_registry( void )
   return global_dispatch_registry;
 }
 
-static void register_function( Function_Type type,
-			       const std::string & dispatch_chars,
-			       Function f )
+DispatchRegistry::DispatchRegistry()
+  : functions( 1 ), slots()
+{}
+
+int DispatchRegistry::intermediate_index( wchar_t intermediate )
+{
+  if ( intermediate == 0 ) {
+    return 0;
+  }
+  if ( intermediate < 0x20 || intermediate > 0x3F ) {
+    return -1;
+  }
+  return intermediate - 0x20 + 1;
+}
+
+void DispatchRegistry::add( Function_Type type, const std::string & dispatch_chars,
+			    const Function &f )
+{
+  assert( dispatch_chars.size() == 1 || dispatch_chars.size() == 2 );
+  const wchar_t intermediate = dispatch_chars.size() == 2 ? static_cast<unsigned char>( dispatch_chars[ 0 ] ) : 0;
+  const wchar_t final = static_cast<unsigned char>( dispatch_chars[ dispatch_chars.size() - 1 ] );
+  const int i = intermediate_index( intermediate );
+  assert( i >= 0 );
+  assert( static_cast<uint32_t>( final ) < static_cast<uint32_t>( NUM_FINALS ) );
+
+  unsigned char &slot = slots[ type ][ i ][ final ];
+  if ( slot == 0 ) { /* first registration wins */
+    assert( functions.size() <= UCHAR_MAX );
+    slot = functions.size();
+    functions.push_back( f );
+  }
+}
+
+const Function *DispatchRegistry::find( Function_Type type, wchar_t intermediate,
+					wchar_t final ) const
 {
-  switch ( type ) {
-  case ESCAPE:
-    get_global_dispatch_registry().escape.insert( dispatch_map_t::value_type( dispatch_chars, f ) );
-    break;
-  case CSI:
-    get_global_dispatch_registry().CSI.insert( dispatch_map_t::value_type( dispatch_chars, f ) );
-    break;
-  case CONTROL:
-    get_global_dispatch_registry().control.insert( dispatch_map_t::value_type( dispatch_chars, f ) );
-    break;
+  const int i = intermediate_index( intermediate );
+  if ( i < 0 || static_cast<uint32_t>( final ) >= static_cast<uint32_t>( NUM_FINALS ) ) {
+    return NULL;
   }
+
+  const unsigned char slot = slots[ type ][ i ][ final ];
+  return slot ? &functions[ slot ] : NULL;
 }
 
 Function::Function( Function_Type type, const std::string & dispatch_chars,
@@ -191,48 +195,50 @@ Function::Function( Function_Type type, const std::string & dispatch_chars,
 		    bool s_clears_wrap_state )
   : function( s_function ), clears_wrap_state( s_clears_wrap_state )
 {
-  register_function( type, dispatch_chars, *this );
+  get_global_dispatch_registry().add( type, dispatch_chars, *this );
 }
 
 void Dispatcher::dispatch( Function_Type type, const Parser::Action *act, Framebuffer *fb )
 {
-  /* add final char to dispatch key */
-  if ( (type == ESCAPE) || (type == CSI) ) {
-    assert( act->char_present );
-    Parser::Collect act2;
-    act2.char_present = true;
-    act2.ch = act->ch;
-    collect( &act2 ); 
-  }
+  assert( act->char_present );
 
-  dispatch_map_t *map = NULL;
-  switch ( type ) {
-  case ESCAPE:  map = &get_global_dispatch_registry().escape;  break;
-  case CSI:     map = &get_global_dispatch_registry().CSI;     break;
-  case CONTROL: map = &get_global_dispatch_registry().control; break;
+  /* Sub-parameters are only defined for SGR.  Elsewhere, treat the
+     sequence as malformed and ignore it, as we did before ':' was
+     parsed at all. */
+  if ( (type == CSI) && has_subparams
+       && !( dispatch_chars.empty() && (act->ch == 'm') ) ) {
+    return;
   }
 
-  std::string key = dispatch_chars;
+  const Function *f = NULL;
   if ( type == CONTROL ) {
-    assert( act->ch <= 255 );
-    char ctrlstr[ 2 ] = { (char)act->ch, 0 };
-    key = std::string( ctrlstr, 1 );
+    f = get_global_dispatch_registry().find( type, 0, act->ch );
+  } else if ( dispatch_chars.size() <= 1 ) {
+    /* more than one intermediate can't match any function */
+    f = get_global_dispatch_registry().find( type,
+					     dispatch_chars.empty() ? 0 : static_cast<unsigned char>( dispatch_chars[ 0 ] ),
+					     act->ch );
   }
 
-  dispatch_map_t::const_iterator i = map->find( key );
-  if ( i == map->end() ) {
+  /* add final char to dispatch key */
+  if ( (type == ESCAPE) || (type == CSI) ) {
+    Parser::Action act2( Parser::COLLECT, act->ch );
+    collect( &act2 );
+  }
+
+  if ( f == NULL ) {
     /* unknown function */
     fb->ds.next_print_will_wrap = false;
     return;
   } else {
-    if ( i->second.clears_wrap_state ) {
+    if ( f->clears_wrap_state ) {
       fb->ds.next_print_will_wrap = false;
     }
-    return i->second.function( fb, this );
+    return f->function( fb, this );
   }
 }
 
-void Dispatcher::OSC_put( const Parser::OSC_Put *act )
+void Dispatcher::OSC_put( const Parser::Action *act )
 {
   assert( act->char_present );
   if ( OSC_string.size() < 256 ) { /* should be a long enough window title */
@@ -240,13 +246,22 @@ void Dispatcher::OSC_put( const Parser::OSC_Put *act )
   }
 }
 
-void Dispatcher::OSC_start( const Parser::OSC_Start *act __attribute((unused)) )
+void Dispatcher::OSC_start( const Parser::Action *act __attribute((unused)) )
 {
   OSC_string.clear();
 }
 
 bool Dispatcher::operator==( const Dispatcher &x ) const
 {
-  return ( params == x.params ) && ( parsed_params == x.parsed_params ) && ( parsed == x.parsed )
-    && ( dispatch_chars == x.dispatch_chars ) && ( OSC_string == x.OSC_string ) && ( terminal_to_host == x.terminal_to_host );
+  if ( ( num_params != x.num_params ) || ( has_subparams != x.has_subparams ) ) {
+    return false;
+  }
+  for ( int i = 0; i < param_count(); i++ ) {
+    if ( ( param_values[ i ] != x.param_values[ i ] )
+	 || ( i > 0 && param_is_sub[ i ] != x.param_is_sub[ i ] ) ) {
+      return false;
+    }
+  }
+
+  return ( dispatch_chars == x.dispatch_chars ) && ( OSC_string == x.OSC_string ) && ( terminal_to_host == x.terminal_to_host );
 }
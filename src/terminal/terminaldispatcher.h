@@ -35,19 +35,9 @@
 
 #include <vector>
 #include <string>
-#include <map>
 
 namespace Parser {
   class Action;
-  class Param;
-  class Collect;
-  class Clear;
-  class Esc_Dispatch;
-  class CSI_Dispatch;
-  class Execute;
-  class OSC_Start;
-  class OSC_Put;
-  class OSC_End;
 }
 
 namespace Terminal {
@@ -66,43 +56,67 @@ namespace Terminal {
     bool clears_wrap_state;
   };
 
-  typedef std::map<std::string, Function> dispatch_map_t;
-
+  /* Functions are looked up in dense tables indexed by the final
+     byte and at most one intermediate or private-marker byte.  No
+     sequence we implement needs more than one. */
   class DispatchRegistry {
   public:
-    dispatch_map_t escape;
-    dispatch_map_t CSI;
-    dispatch_map_t control;
+    static const int NUM_INTERMEDIATES = 0x21; /* none, or 0x20-0x3F */
+    static const int NUM_FINALS = 0xA0; /* C0, GL and C1 */
+
+  private:
+    std::vector<Function> functions; /* entry 0 means no function */
+    unsigned char slots[ CONTROL + 1 ][ NUM_INTERMEDIATES ][ NUM_FINALS ];
+
+    static int intermediate_index( wchar_t intermediate );
+
+  public:
+    DispatchRegistry();
 
-    DispatchRegistry() : escape(), CSI(), control() {}
+    void add( Function_Type type, const std::string & dispatch_chars, const Function &f );
+
+    /* intermediate is 0 if there is none.  Returns NULL for unknown sequences. */
+    const Function *find( Function_Type type, wchar_t intermediate, wchar_t final ) const;
   };
 
   DispatchRegistry & get_global_dispatch_registry( void );
 
   class Dispatcher {
+  public:
+    static const int PARAM_MAX = 65535;
+    /* prevent evil escape sequences from causing long loops */
+
+    /* later parameters are dropped; this is enough for every
+       parameter string that fit in the old 100-byte buffer */
+    static const size_t MAX_PARAMS = 101;
+
   private:
-    std::string params;
-    std::vector<int> parsed_params;
-    bool parsed;
+    /* Parameters are accumulated as their digits arrive.  A value of
+       -1 means the parameter was empty, and values above PARAM_MAX
+       stick at PARAM_MAX + 1 and read as out of range. */
+    int param_values[ MAX_PARAMS ];
+    bool param_is_sub[ MAX_PARAMS ]; /* introduced by ':' rather than ';' */
+    size_t num_params; /* at least 1; MAX_PARAMS + 1 once some were dropped */
+    bool has_subparams; /* any ':' seen, even in a dropped parameter */
 
     std::string dispatch_chars;
     std::vector<wchar_t> OSC_string; /* only used to set the window title */
 
-    void parse_params( void );
-
   public:
-    static const int PARAM_MAX = 65535;
-    /* prevent evil escape sequences from causing long loops */
 
     std::string terminal_to_host; /* this is the reply string */
 
     Dispatcher();
-    int getparam( size_t N, int defaultval );
-    int param_count( void );
-
-    void newparamchar( const Parser::Param *act );
-    void collect( const Parser::Collect *act );
-    void clear( const Parser::Clear *act );
+    int getparam( size_t N, int defaultval ) const;
+    int param_count( void ) const { return num_params > MAX_PARAMS ? MAX_PARAMS : num_params; }
+    /* true if parameter N is a colon-separated sub-parameter.  Only
+       SGR understands these; other sequences containing ':' are
+       ignored before dispatch. */
+    bool is_subparam( size_t N ) const { return (int)N < param_count() && param_is_sub[ N ]; }
+
+    void newparamchar( const Parser::Action *act );
+    void collect( const Parser::Action *act );
+    void clear( const Parser::Action *act );
     
     std::string str( void );
 
@@ -110,9 +124,9 @@ namespace Terminal {
     std::string get_dispatch_chars( void ) const { return dispatch_chars; }
     std::vector<wchar_t> get_OSC_string( void ) const { return OSC_string; }
 
-    void OSC_put( const Parser::OSC_Put *act );
-    void OSC_start( const Parser::OSC_Start *act );
-    void OSC_dispatch( const Parser::OSC_End *act, Framebuffer *fb );
+    void OSC_put( const Parser::Action *act );
+    void OSC_start( const Parser::Action *act );
+    void OSC_dispatch( const Parser::Action *act, Framebuffer *fb );
 
     bool operator==( const Dispatcher &x ) const;
   };
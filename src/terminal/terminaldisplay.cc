@@ -30,7 +30,13 @@
     also delete it here.
 */
 
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 #include "terminaldisplay.h"
 #include "terminalframebuffer.h"
@@ -58,6 +64,33 @@ std::string Display::close() const
     std::string( rmcup ? rmcup : "" );
 }
 
+static int decimal_length( int n )
+{
+  int len = 1;
+  while ( n >= 10 ) {
+    n /= 10;
+    len++;
+  }
+  return len;
+}
+
+/* CSI n <final>, leaving out n when it is 1 */
+static int csi_count_cost( int n )
+{
+  return n == 1 ? 3 : 3 + decimal_length( n );
+}
+
+static void append_csi_count( FrameState &frame, int n, char final )
+{
+  char tmp[ 64 ];
+  if ( n == 1 ) {
+    snprintf( tmp, 64, "\033[%c", final );
+  } else {
+    snprintf( tmp, 64, "\033[%d%c", n, final );
+  }
+  frame.append( tmp );
+}
+
 std::string Display::new_frame( bool initialized, const Framebuffer &last, const Framebuffer &f ) const
 {
   FrameState frame( last );
@@ -148,8 +181,9 @@ std::string Display::new_frame( bool initialized, const Framebuffer &last, const
   /* Extend rows if we've gotten a resize and new is wider than old */
   if ( frame.last_frame.ds.get_width() < f.ds.get_width() ) {
     for ( Framebuffer::rows_type::iterator p = rows.begin(); p != rows.end(); p++ ) {
-      *p = make_shared<Row>( **p );
+      *p = RowPool::copy_row( **p );
       (*p)->cells.resize( f.ds.get_width(), Cell( f.ds.get_background_rendition() ) );
+      (*p)->damage( 0, f.ds.get_width() );
     }
   }
   /* Add rows if we've gotten a resize and new is taller than old */
@@ -157,96 +191,13 @@ std::string Display::new_frame( bool initialized, const Framebuffer &last, const
     // get a proper blank row
     const size_t w = f.ds.get_width();
     const color_type c = 0;
-    blank_row = make_shared<Row>( w, c );
+    blank_row = RowPool::make_row( w, c );
     rows.resize( f.ds.get_height(), blank_row );
   }
 
-  /* shortcut -- has display moved up by a certain number of lines? */
+  /* shortcut -- have blocks of lines moved up or down? */
   if ( initialized ) {
-    int lines_scrolled = 0;
-    int scroll_height = 0;
-
-    for ( int row = 0; row < f.ds.get_height(); row++ ) {
-      const Row *new_row = f.get_row( 0 );
-      const Row *old_row = &*rows.at( row );
-      if ( new_row == old_row || *new_row == *old_row ) {
-	/* if row 0, we're looking at ourselves and probably didn't scroll */
-	if ( row == 0 ) {
-	  break;
-	}
-	/* found a scroll */
-	lines_scrolled = row;
-	scroll_height = 1;
-
-	/* how big is the region that was scrolled? */
-	for ( int region_height = 1;
-	      lines_scrolled + region_height < f.ds.get_height();
-	      region_height++ ) {
-	  if ( *f.get_row( region_height )
-	       == *rows.at( lines_scrolled + region_height ) ) {
-	    scroll_height = region_height + 1;
-	  } else {
-	    break;
-	  }
-	}
-
-	break;
-      }
-    }
-
-    if ( scroll_height ) {
-      frame_y = scroll_height;
-
-      if ( lines_scrolled ) {
-	/* Now we need a proper blank row. */
-	if ( blank_row.get() == NULL ) {
-	  const size_t w = f.ds.get_width();
-	  const color_type c = 0;
-	  blank_row = make_shared<Row>( w, c );
-	}
-	frame.update_rendition( initial_rendition(), true );
-
-	int top_margin = 0;
-	int bottom_margin = top_margin + lines_scrolled + scroll_height - 1;
-
-	assert( bottom_margin < f.ds.get_height() );
-
-	/* Common case:  if we're already on the bottom line and we're scrolling the whole
-	 * screen, just do a CR and LFs.
-	 */
-	if ( (scroll_height + lines_scrolled == f.ds.get_height() ) && frame.cursor_y + 1 == f.ds.get_height() ) {
-	  frame.append( '\r' );
-	  frame.append( lines_scrolled, '\n' );
-	  frame.cursor_x = 0;
-	} else {
-	  /* set scrolling region */
-	  snprintf( tmp, 64, "\033[%d;%dr",
-		    top_margin + 1, bottom_margin + 1);
-	  frame.append( tmp );
-
-	  /* go to bottom of scrolling region */
-	  frame.cursor_x = frame.cursor_y = -1;
-	  frame.append_silent_move( bottom_margin, 0 );
-
-	  /* scroll */
-	  frame.append( lines_scrolled, '\n' );
-
-	  /* reset scrolling region */
-	  frame.append( "\033[r" );
-	  /* invalidate cursor position after unsetting scrolling region */
-	  frame.cursor_x = frame.cursor_y = -1;
-	}
-
-	/* do the move in our local index */
-	for ( int i = top_margin; i <= bottom_margin; i++ ) {
-	  if ( i + lines_scrolled <= bottom_margin ) {
-	    rows.at( i ) = rows.at( i + lines_scrolled );
-	  } else {
-	    rows.at( i ) = blank_row;
-	  }
-	}
-      }
-    }
+    scroll_rows( frame, f, rows );
   }
 
   /* Now update the display, row by row */
@@ -259,7 +210,7 @@ std::string Display::new_frame( bool initialized, const Framebuffer &last, const
   if ( (!initialized)
        || (f.ds.get_cursor_row() != frame.cursor_y)
        || (f.ds.get_cursor_col() != frame.cursor_x) ) {
-    frame.append_move( f.ds.get_cursor_row(), f.ds.get_cursor_col() );
+    frame.append_move( f.ds.get_cursor_row(), f.ds.get_cursor_col(), f.get_row( f.ds.get_cursor_row() ) );
   }
 
   /* has cursor visibility changed? */
@@ -325,6 +276,273 @@ std::string Display::new_frame( bool initialized, const Framebuffer &last, const
   return frame.str;
 }
 
+/* Find blocks of rows that have moved up or down since the last frame,
+   and move them with the terminal's own scrolling, inside a scrolling
+   region around each block.  rows (the last frame's) is updated to
+   match what the terminal then shows. */
+/* True if the row has nothing in it, so that it can be drawn by
+   clearing it. */
+static bool blank_row_contents( const Row &row )
+{
+  const Cell &first = row.cells.front();
+  for ( Row::cells_type::const_iterator i = row.cells.begin(); i != row.cells.end(); i++ ) {
+    if ( !i->empty() || !( i->get_renditions() == first.get_renditions() ) ) {
+      return false;
+    }
+  }
+  return !row.get_wrap();
+}
+
+void Display::scroll_rows( FrameState &frame, const Framebuffer &f, Framebuffer::rows_type &rows ) const
+{
+  char tmp[ 64 ];
+  const int height = f.ds.get_height();
+  Framebuffer::row_pointer blank_row;
+
+  /* Interned blank rows all share one generation, which would match
+     any run of blank lines, so they are not used to find blocks. */
+  const bool shared_blanks = RowPool::get_interning();
+
+  /* Rows are only equal if they have the same generation, so look up
+     candidates in the old rows sorted by generation. */
+  typedef std::vector< std::pair<uint64_t, int> > generations_type;
+  generations_type generations;
+
+  for ( int y = 0; y < height; y++ ) {
+    const Row &new_row = *f.get_row( y );
+    if ( new_row == *rows.at( y ) || ( shared_blanks && blank_row_contents( new_row ) ) ) {
+      continue;
+    }
+
+    if ( generations.empty() ) {
+      generations.reserve( height );
+      for ( int i = 0; i < height; i++ ) {
+	generations.push_back( std::make_pair( rows.at( i )->gen, i ) );
+      }
+      std::sort( generations.begin(), generations.end() );
+    }
+
+    /* find the longest run of old rows matching new rows from y */
+    int from = -1, count = 0;
+    for ( generations_type::const_iterator i = std::lower_bound( generations.begin(), generations.end(),
+								 std::make_pair( new_row.gen, 0 ) );
+	  i != generations.end() && i->first == new_row.gen;
+	  i++ ) {
+      const int k = i->second;
+      if ( k == y || !( new_row == *rows.at( k ) ) ) {
+	continue;
+      }
+      int n = 1;
+      while ( y + n < height && k + n < height && *f.get_row( y + n ) == *rows.at( k + n ) ) {
+	n++;
+      }
+      if ( n > count ) {
+	from = k;
+	count = n;
+      }
+    }
+
+    if ( from < 0 ) {
+      continue;
+    }
+
+    /* The region runs from the block's old to new position; the
+       lines scrolled in become blank. */
+    const int lines_scrolled = from - y; /* positive scrolls up */
+    const int top = std::min( from, y );
+    const int bottom = std::max( from, y ) + count - 1;
+
+    /* Only scroll if more rows end up right than end up wrong.
+       Shared blank rows are cheap to clear, so they don't count. */
+    int gain = 0;
+    for ( int i = top; i <= bottom; i++ ) {
+      const int source = i + lines_scrolled;
+      const Row &want = *f.get_row( i );
+      if ( shared_blanks && blank_row_contents( want ) ) {
+	continue;
+      }
+      const bool right_before = ( want == *rows.at( i ) );
+      const bool right_after = ( source >= top ) && ( source <= bottom ) && ( want == *rows.at( source ) );
+      gain += int( right_after ) - int( right_before );
+    }
+    if ( gain <= 0 ) {
+      continue;
+    }
+
+    frame.update_rendition( initial_rendition(), true );
+
+    if ( lines_scrolled > 0 ) {
+      /* Common case:  if we're already on the bottom line and we're scrolling the whole
+       * screen, just do a CR and LFs.
+       */
+      if ( top == 0 && bottom == height - 1 && frame.cursor_y + 1 == height ) {
+	frame.append( '\r' );
+	frame.append( lines_scrolled, '\n' );
+	frame.cursor_x = 0;
+      } else {
+	/* set scrolling region */
+	snprintf( tmp, 64, "\033[%d;%dr", top + 1, bottom + 1 );
+	frame.append( tmp );
+
+	/* go to bottom of scrolling region */
+	frame.cursor_x = frame.cursor_y = -1;
+	frame.append_silent_move( bottom, 0 );
+
+	/* scroll */
+	frame.append( lines_scrolled, '\n' );
+
+	/* reset scrolling region */
+	frame.append( "\033[r" );
+	/* invalidate cursor position after unsetting scrolling region */
+	frame.cursor_x = frame.cursor_y = -1;
+      }
+    } else {
+      /* set scrolling region */
+      snprintf( tmp, 64, "\033[%d;%dr", top + 1, bottom + 1 );
+      frame.append( tmp );
+
+      /* go to top of scrolling region */
+      frame.cursor_x = frame.cursor_y = -1;
+      frame.append_silent_move( top, 0 );
+
+      /* scroll down with reverse index */
+      for ( int i = 0; i < -lines_scrolled; i++ ) {
+	frame.append( "\033M" );
+      }
+
+      /* reset scrolling region */
+      frame.append( "\033[r" );
+      /* invalidate cursor position after unsetting scrolling region */
+      frame.cursor_x = frame.cursor_y = -1;
+    }
+
+    /* do the move in our local index */
+    if ( blank_row.get() == NULL ) {
+      const size_t w = f.ds.get_width();
+      const color_type c = 0;
+      blank_row = RowPool::make_row( w, c );
+    }
+    if ( lines_scrolled > 0 ) {
+      for ( int i = top; i <= bottom; i++ ) {
+	rows.at( i ) = ( i + lines_scrolled <= bottom ) ? rows.at( i + lines_scrolled ) : blank_row;
+      }
+    } else {
+      for ( int i = bottom; i >= top; i-- ) {
+	rows.at( i ) = ( i + lines_scrolled >= top ) ? rows.at( i + lines_scrolled ) : blank_row;
+      }
+    }
+    generations.clear();
+
+    /* the block now matches; carry on below it */
+    y = std::max( from, y ) + count - 1;
+  }
+}
+
+/* Count the cells of row from column start on that would match
+   after inserting (shift > 0) or deleting (shift < 0) cells at start,
+   or -1 if that would split a wide character. */
+static int shifted_matches( const Row::cells_type &cells, const Row::cells_type &old_cells,
+			    int start, int shift, const Cell &blank )
+{
+  const int width = cells.size();
+  if ( shift > 0 ? old_cells[ width - 1 - shift ].get_wide()
+       : old_cells[ start - shift - 1 ].get_wide() ) {
+    return -1;
+  }
+  int matches = 0;
+  for ( int x = start; x < width; x++ ) {
+    const int from = x - shift;
+    const Cell &moved = ( from >= start && from < width ) ? old_cells[ from ] : blank;
+    if ( cells[ x ] == moved ) {
+      matches++;
+    }
+  }
+  return matches;
+}
+
+bool Display::shift_cells( FrameState &frame, int frame_y, int start,
+			   const Row::cells_type &cells, const Row::cells_type &old_cells,
+			   Row::cells_type &shifted ) const
+{
+  /* Don't look for long shifts; they are costly to find and rare. */
+  const int MAX_SHIFT = 32;
+  const int width = cells.size();
+
+  /* Shift from the first change, at the start of a character. */
+  int x = start;
+  while ( x < width && cells[ x ] == old_cells[ x ] ) {
+    x++;
+  }
+  if ( x > 0 && cells[ x - 1 ].get_wide() ) {
+    x--;
+  }
+  /* A shift can't save more than the changed cells. */
+  int last = width - 1;
+  while ( last > x && cells[ last ] == old_cells[ last ] ) {
+    last--;
+  }
+  if ( last - x < 4 ) {
+    return false;
+  }
+
+  /* The terminal fills the cells it opens up with the background
+     color, or the default one without bce. */
+  if ( !has_bce && frame.current_rendition.background_color ) {
+    return false;
+  }
+  const Cell blank( frame.current_rendition.background_color );
+
+  int unshifted = 0;
+  for ( int i = x; i < width; i++ ) {
+    if ( cells[ i ] == old_cells[ i ] ) {
+      unshifted++;
+    }
+  }
+
+  /* Pick the shift that matches the most cells, if that pays for
+     the sequence; a cell takes at least a byte to draw. */
+  int best_shift = 0;
+  int best_gain = 0;
+  for ( int n = 1; n <= MAX_SHIFT && x + n < width; n++ ) {
+    const int candidates[] = { n, -n };
+    for ( int i = 0; i < 2; i++ ) {
+      const int shift = candidates[ i ];
+      /* Cheap test first: one of the cells just after the edit must
+	 carry over. */
+      bool carried = false;
+      for ( int j = 0; j < 4 && !carried; j++ ) {
+	const int to = x + std::max( shift, 0 ) + j, from = to - shift;
+	carried = to < width && from < width && cells[ to ] == old_cells[ from ];
+      }
+      if ( !carried ) {
+	continue;
+      }
+      const int matches = shifted_matches( cells, old_cells, x, shift, blank );
+      const int gain = matches - unshifted - csi_count_cost( n );
+      if ( matches >= 0 && gain > best_gain ) {
+	best_gain = gain;
+	best_shift = shift;
+      }
+    }
+  }
+  if ( best_shift == 0 ) {
+    return false;
+  }
+
+  frame.append_silent_move( frame_y, x );
+  append_csi_count( frame, abs( best_shift ), best_shift > 0 ? '@' : 'P' );
+
+  shifted = old_cells;
+  if ( best_shift > 0 ) {
+    shifted.insert( shifted.begin() + x, best_shift, blank );
+    shifted.resize( width );
+  } else {
+    shifted.erase( shifted.begin() + x, shifted.begin() + x - best_shift );
+    shifted.resize( width, blank );
+  }
+  return true;
+}
+
 bool Display::put_row( bool initialized, FrameState &frame, const Framebuffer &f, int frame_y, const Row &old_row, bool wrap ) const
 {
   char tmp[ 64 ];
@@ -332,7 +550,8 @@ bool Display::put_row( bool initialized, FrameState &frame, const Framebuffer &f
 
   const Row &row = *f.get_row( frame_y );
   const Row::cells_type &cells = row.cells;
-  const Row::cells_type &old_cells = old_row.cells;
+  const Row::cells_type *old_cells = &old_row.cells;
+  Row::cells_type shifted_cells;
 
   /* If we're forced to write the first column because of wrap, go ahead and do so. */
   if ( wrap ) {
@@ -354,15 +573,39 @@ bool Display::put_row( bool initialized, FrameState &frame, const Framebuffer &f
   bool wrote_last_cell = false;
   Renditions blank_renditions = initial_rendition();
 
+  /* If the row descends from old_row, only its damaged columns can
+     differ.  Start one column early in case the cell before them is
+     wide, and stop once past them with nothing pending. */
+  int damage_start = 0, damage_end = row_width;
+  if ( initialized && row.derived_from( old_row, damage_start, damage_end ) ) {
+    if ( damage_start >= damage_end ) {
+      return false; /* equal to old_row, as when interning swapped it in */
+    }
+    if ( frame_x < damage_start - 1 ) {
+      frame_x = damage_start - 1;
+    }
+  }
+
+  /* Shifting the rest of the line may leave less to draw. */
+  if ( initialized && has_ich_dch
+       && shift_cells( frame, frame_y, frame_x, cells, *old_cells, shifted_cells ) ) {
+    old_cells = &shifted_cells;
+    damage_end = row_width;
+  }
+
   /* iterate for every cell */
   while ( frame_x < row_width ) {
 
+    if ( frame_x >= damage_end && !clear_count ) {
+      break;
+    }
+
     const Cell &cell = cells.at( frame_x );
 
     /* Does cell need to be drawn?  Skip all this. */
     if ( initialized
 	 && !clear_count
-	 && ( cell == old_cells.at( frame_x ) ) ) {
+	 && ( cell == old_cells->at( frame_x ) ) ) {
       frame_x += cell.get_width();
       continue;
     }
@@ -383,7 +626,7 @@ bool Display::put_row( bool initialized, FrameState &frame, const Framebuffer &f
     /* Clear or write cells within the row (not to end). */
     if ( clear_count ) {
       /* Move to the right position. */
-      frame.append_silent_move( frame_y, frame_x - clear_count );
+      frame.append_silent_move( frame_y, frame_x - clear_count, &row );
       frame.update_rendition( blank_renditions );
       bool can_use_erase = has_bce || ( frame.current_rendition == initial_rendition() );
       if ( can_use_erase && has_ech ) {
@@ -418,7 +661,7 @@ bool Display::put_row( bool initialized, FrameState &frame, const Framebuffer &f
     if ( wrap_this && frame_x + cell_width >= row_width ) {
       frame.cursor_x = frame.cursor_y = -1;
     }
-    frame.append_silent_move( frame_y, frame_x );
+    frame.append_silent_move( frame_y, frame_x, &row );
     frame.update_rendition( cell.get_renditions() );
     frame.append_cell( cell );
     frame_x += cell_width;
@@ -426,6 +669,21 @@ bool Display::put_row( bool initialized, FrameState &frame, const Framebuffer &f
     if ( frame_x >= row_width ) {
       wrote_last_cell = true;
     }
+
+    /* Repeat the character over a run of identical cells.  The run
+       stops short of the last column, which is handled above. */
+    if ( has_rep && cell_width == 1 && cell.single_character() ) {
+      int run = 0;
+      while ( frame_x + run < row_width - 1 && cells.at( frame_x + run ) == cell ) {
+	run++;
+      }
+      if ( run > 1 && 3 + decimal_length( run ) < run * static_cast<int>( cell.grapheme_size() ) ) {
+	snprintf( tmp, 64, "\033[%db", run );
+	frame.append( tmp );
+	frame_x += run;
+	frame.cursor_x += run;
+      }
+    }
   }
 
   /* End of line. */
@@ -433,7 +691,7 @@ bool Display::put_row( bool initialized, FrameState &frame, const Framebuffer &f
   /* Clear or write empty cells at EOL. */
   if ( clear_count ) {
     /* Move to the right position. */
-    frame.append_silent_move( frame_y, frame_x - clear_count );
+    frame.append_silent_move( frame_y, frame_x - clear_count, &row );
     frame.update_rendition( blank_renditions );
 
     bool can_use_erase = !wrap_this && ( has_bce || ( frame.current_rendition == initial_rendition() ) );
@@ -475,7 +733,7 @@ FrameState::FrameState( const Framebuffer &s_last )
   str.reserve( last_frame.ds.get_width() * last_frame.ds.get_height() * 4 );
 }
 
-void FrameState::append_silent_move( int y, int x )
+void FrameState::append_silent_move( int y, int x, const Row *row )
 {
   if ( cursor_x == x && cursor_y == y ) return;
   /* turn off cursor if necessary before moving cursor */
@@ -483,41 +741,150 @@ void FrameState::append_silent_move( int y, int x )
     append( "\033[?25l" );
     cursor_visible = false;
   }
-  append_move( y, x );
+  append_move( y, x, row );
 }
 
-void FrameState::append_move( int y, int x )
+/* Bytes needed to move right from column from to column to by
+   printing the row's cells again, or -1 if that would not leave the
+   screen the same: the cells must be narrow, drawn in the current
+   rendition, and not the right half of a wide character. */
+static int reprint_cost( const Row *row, int from, int to, const Renditions &current )
+{
+  if ( row == NULL || ( from > 0 && row->cells[ from - 1 ].get_wide() ) ) {
+    return -1;
+  }
+  int cost = 0;
+  for ( int i = from; i < to; i++ ) {
+    const Cell &cell = row->cells[ i ];
+    if ( cell.get_wide() || cell.get_fallback() || !( cell.get_renditions() == current ) ) {
+      return -1;
+    }
+    std::string grapheme;
+    cell.print_grapheme( grapheme );
+    cost += grapheme.size();
+  }
+  return cost;
+}
+
+void FrameState::append_move( int y, int x, const Row *row )
 {
   const int last_x = cursor_x;
   const int last_y = cursor_y;
   cursor_x = x;
   cursor_y = y;
-  // Only optimize if cursor pos is known
-  if ( last_x != -1 && last_y != -1 ) {
-    // Can we use CR and/or LF?  They're cheap and easier to trace.
-    if ( x == 0 && y - last_y >= 0 && y - last_y < 5 ) {
-      if ( last_x != 0 ) {
-	append( '\r' );
+
+  /* Absolute position, leaving out a column of 1 */
+  int best_cost = 3 + decimal_length( y + 1 ) + ( x ? 1 + decimal_length( x + 1 ) : 0 );
+
+  /* Only use relative motion if cursor pos is known */
+  if ( last_x == -1 || last_y == -1 ) {
+    append_cup( y, x );
+    return;
+  }
+
+  /* Vertical motion keeps the column.  LF only moves down, since
+     there is no scrolling region set outside of scrolling. */
+  const int dy = y - last_y;
+  int vertical_cost = 0;
+  if ( dy > 0 ) {
+    vertical_cost = std::min( dy, csi_count_cost( dy ) );
+  } else if ( dy < 0 ) {
+    vertical_cost = csi_count_cost( -dy );
+  }
+
+  /* Horizontal motion, either from the current column or after a CR.
+     Past the last column the terminal may be about to wrap, and
+     only a CR is certain to land where we expect. */
+  enum { NONE, BACKSPACE, BACK, FORWARD, REPRINT } method = NONE, cr_method = NONE;
+  const bool column_known = last_x < last_frame.ds.get_width();
+  int horizontal_cost = INT_MAX;
+  if ( column_known ) {
+    const int dx = x - last_x;
+    if ( dx == 0 ) {
+      horizontal_cost = 0;
+    } else if ( dx < 0 ) {
+      horizontal_cost = std::min( -dx, csi_count_cost( -dx ) );
+      method = ( -dx <= horizontal_cost ) ? BACKSPACE : BACK;
+    } else {
+      horizontal_cost = csi_count_cost( dx );
+      method = FORWARD;
+      const int reprint = reprint_cost( row, last_x, x, current_rendition );
+      if ( reprint >= 0 && reprint <= horizontal_cost ) {
+	horizontal_cost = reprint;
+	method = REPRINT;
       }
-      append( y - last_y, '\n' );
-      return;
     }
-    // Backspaces are good too.
-    if ( y == last_y && x - last_x < 0 && x - last_x > -5 ) {
-      append( last_x - x, '\b' );
-      return;
+  }
+  int cr_cost = 1;
+  if ( x > 0 ) {
+    cr_cost += csi_count_cost( x );
+    cr_method = FORWARD;
+    const int reprint = reprint_cost( row, 0, x, current_rendition );
+    if ( reprint >= 0 && reprint + 1 <= cr_cost ) {
+      cr_cost = reprint + 1;
+      cr_method = REPRINT;
+    }
+  }
+  /* CR is cheap and easier to trace, so prefer it on a tie. */
+  const bool use_cr = cr_cost <= horizontal_cost;
+  if ( use_cr ) {
+    horizontal_cost = cr_cost;
+    method = cr_method;
+  }
+
+  if ( vertical_cost + horizontal_cost >= best_cost ) {
+    append_cup( y, x );
+    return;
+  }
+
+  if ( use_cr ) {
+    append( '\r' );
+  }
+  if ( dy > 0 ) {
+    if ( dy <= csi_count_cost( dy ) ) {
+      append( dy, '\n' );
+    } else {
+      append_csi_count( *this, dy, 'B' );
+    }
+  } else if ( dy < 0 ) {
+    append_csi_count( *this, -dy, 'A' );
+  }
+  const int from = use_cr ? 0 : last_x;
+  switch ( method ) {
+  case NONE:
+    break;
+  case BACKSPACE:
+    append( from - x, '\b' );
+    break;
+  case BACK:
+    append_csi_count( *this, from - x, 'D' );
+    break;
+  case FORWARD:
+    append_csi_count( *this, x - from, 'C' );
+    break;
+  case REPRINT:
+    for ( int i = from; i < x; i++ ) {
+      append_cell( row->cells[ i ] );
     }
-    // More optimizations are possible.
+    break;
   }
+}
+
+void FrameState::append_cup( int y, int x )
+{
   char tmp[ 64 ];
-  snprintf( tmp, 64, "\033[%d;%dH", y + 1, x + 1 );
+  if ( x == 0 ) {
+    snprintf( tmp, 64, "\033[%dH", y + 1 );
+  } else {
+    snprintf( tmp, 64, "\033[%d;%dH", y + 1, x + 1 );
+  }
   append( tmp );
 }
 
 void FrameState::update_rendition(const Renditions &r, bool force) {
   if ( force || !(current_rendition == r) ) {
-    /* print renditions */
-    append_string( r.sgr() );
+    /* print renditions, only the change unless we don't know the current ones */
+    append_string( force ? r.sgr() : r.sgr( current_rendition ) );
     current_rendition = r;
   }
 }
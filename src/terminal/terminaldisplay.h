@@ -56,8 +56,12 @@ namespace Terminal {
     void append_string( const std::string &append ) { str.append(append); }
 
     void append_cell(const Cell & cell) { cell.print_grapheme( str ); }
-    void append_silent_move( int y, int x );
-    void append_move( int y, int x );
+    /* Move the cursor by the cheapest sequence.  If row is given, it
+       holds the new contents of line y, and cells of it may be
+       reprinted to move right. */
+    void append_silent_move( int y, int x, const Row *row = NULL );
+    void append_move( int y, int x, const Row *row = NULL );
+    void append_cup( int y, int x );
     void update_rendition( const Renditions &r, bool force = false );
   };
 
@@ -72,10 +76,18 @@ namespace Terminal {
 
     bool has_bce; /* erases result in cell filled with background color */
 
+    bool has_rep; /* repeat the last character printed */
+
+    bool has_ich_dch; /* insert and delete characters */
+
     bool has_title; /* supports window title and icon name */
 
     const char *smcup, *rmcup; /* enter and exit alternate screen mode */
 
+    void scroll_rows( FrameState &frame, const Framebuffer &f, Framebuffer::rows_type &rows ) const;
+    bool shift_cells( FrameState &frame, int frame_y, int start,
+		      const Row::cells_type &cells, const Row::cells_type &old_cells,
+		      Row::cells_type &shifted ) const;
     bool put_row( bool initialized, FrameState &frame, const Framebuffer &f, int frame_y, const Row &old_row, bool wrap ) const;
 
   public:
@@ -90,7 +90,7 @@ const char *Display::ti_str( const char *capname )
 }
 
 Display::Display( bool use_environment )
-  : has_ech( true ), has_bce( true ), has_title( true ), smcup( NULL ), rmcup( NULL )
+  : has_ech( true ), has_bce( true ), has_rep( false ), has_ich_dch( true ), has_title( true ), smcup( NULL ), rmcup( NULL )
 {
   if ( use_environment ) {
     int errret = -2;
@@ -119,6 +119,13 @@ Display::Display( bool use_environment )
     /* check for BCE */
     has_bce = ti_flag( "bce" );
 
+    /* check for ICH and DCH */
+    has_ich_dch = ti_str( "ich" ) && ti_str( "dch" );
+
+    /* check for REP.  It stays off otherwise, since the diffs sent
+       to mosh clients are applied by our own emulator, which lacks it. */
+    has_rep = ti_str( "rep" );
+
     /* Check if we can set the window title and icon name.  terminfo does not
        have reliable information on this, so we hardcode a whitelist of
        terminal type prefixes.  This is the list from Debian's default
@@ -33,49 +33,169 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <algorithm>
+#include <map>
 
 #include "terminalframebuffer.h"
 
 using namespace Terminal;
 
 Cell::Cell( color_type background_color )
-  : contents(),
-    renditions( background_color ),
-    wide( false ),
-    fallback( false ),
-    wrap( false )
-{}
+  : renditions( background_color ),
+    flags( 0 ),
+    length( 0 )
+{
+  memset( contents, 0, sizeof( contents ) );
+}
+
 Cell::Cell() /* default constructor required by C++11 STL */
-  : contents(),
-    renditions( 0 ),
-    wide( false ),
-    fallback( false ),
-    wrap( false )
+  : renditions( 0 ),
+    flags( 0 ),
+    length( 0 )
 {
+  memset( contents, 0, sizeof( contents ) );
   assert( false );
 }
 
 void Cell::reset( color_type background_color )
 {
-  contents.clear();
+  if ( flags & INTERNED ) {
+    release_interned();
+  }
   renditions = Renditions( background_color );
-  wide = false;
-  fallback = false;
-  wrap = false;
+  flags = 0;
+  length = 0;
+  memset( contents, 0, sizeof( contents ) );
+}
+
+/* Side table of combining sequences too long to store in a cell.
+   Equal contents always get the same index, so cells can still be
+   compared bytewise.  An entry counts the cells holding its index
+   and its slot is reused once the last of them lets go, so the table
+   only fills if that many distinct long sequences are on screen and
+   in the states kept for diffing at once; then, long sequences
+   simply stop growing. */
+static const size_t MAX_INTERNED = 65536;
+
+namespace {
+  struct InternedContents {
+    std::string contents;
+    uint32_t references;
+  };
+
+  typedef std::map<std::string, uint32_t> contents_map_type;
+
+  struct ContentsTable {
+    std::vector<InternedContents> entries;
+    std::vector<uint32_t> free_slots;
+    contents_map_type index;
+
+    ContentsTable() : entries(), free_slots(), index() {}
+  };
+}
+
+/* Never destroyed, since static Cells may outlive it at exit */
+static ContentsTable & contents_table( void )
+{
+  static ContentsTable *table = new ContentsTable;
+  return *table;
+}
+
+static uint32_t interned_index( const char *contents )
+{
+  uint32_t index;
+  memcpy( &index, contents, sizeof( index ) );
+  return index;
+}
+
+const char *Cell::contents_data( void ) const
+{
+  if ( !( flags & INTERNED ) ) {
+    return contents;
+  }
+  return contents_table().entries[ interned_index( contents ) ].contents.data();
+}
+
+void Cell::retain_interned( void ) const
+{
+  contents_table().entries[ interned_index( contents ) ].references++;
+}
+
+void Cell::release_interned( void )
+{
+  ContentsTable &table = contents_table();
+  const uint32_t index = interned_index( contents );
+  InternedContents &entry = table.entries[ index ];
+  assert( entry.references > 0 );
+  if ( --entry.references == 0 ) {
+    table.index.erase( entry.contents );
+    std::string().swap( entry.contents );
+    table.free_slots.push_back( index );
+  }
+}
+
+void Cell::append_interned( const char *s, size_t len )
+{
+  std::string longer( contents_data(), length );
+  longer.append( s, len );
+  if ( longer.size() > UCHAR_MAX ) {
+    return;
+  }
+
+  ContentsTable &table = contents_table();
+  contents_map_type::const_iterator it = table.index.find( longer );
+  uint32_t index;
+  if ( it != table.index.end() ) {
+    index = it->second;
+  } else if ( !table.free_slots.empty() ) {
+    index = table.free_slots.back();
+    table.free_slots.pop_back();
+    table.entries[ index ].contents = longer;
+    table.index[ longer ] = index;
+  } else if ( table.entries.size() < MAX_INTERNED ) {
+    index = table.entries.size();
+    InternedContents entry = { longer, 0 };
+    table.entries.push_back( entry );
+    table.index[ longer ] = index;
+  } else {
+    /* Unavoidable; keep what the cell already holds */
+    return;
+  }
+  table.entries[ index ].references++;
+
+  if ( flags & INTERNED ) {
+    release_interned();
+  }
+  flags |= INTERNED;
+  length = longer.size();
+  memset( contents, 0, sizeof( contents ) );
+  memcpy( contents, &index, sizeof( index ) );
+}
+
+std::vector<bool> & DrawState::writable_tabs( void )
+{
+  if ( tabs.use_count() != 1 ) {
+    tabs = make_shared< std::vector<bool> >( *tabs );
+  }
+  return *tabs;
 }
 
 void DrawState::reinitialize_tabs( unsigned int start )
 {
   assert( default_tabs );
-  for ( unsigned int i = start; i < tabs.size(); i++ ) {
-    tabs[ i ] = ( (i % 8) == 0 );
+  std::vector<bool> &t = writable_tabs();
+  for ( unsigned int i = start; i < t.size(); i++ ) {
+    t[ i ] = ( (i % 8) == 0 );
   }
 }
 
 DrawState::DrawState( int s_width, int s_height )
   : width( s_width ), height( s_height ),
     cursor_col( 0 ), cursor_row( 0 ),
-    combining_char_col( 0 ), combining_char_row( 0 ), default_tabs( true ), tabs( s_width ),
+    combining_char_col( 0 ), combining_char_row( 0 ), default_tabs( true ), tabs( make_shared< std::vector<bool> >( static_cast<size_t>( s_width ) ) ),
     scrolling_region_top_row( 0 ), scrolling_region_bottom_row( height - 1 ),
     renditions( 0 ), save(),
     next_print_will_wrap( false ), origin_mode( false ), auto_wrap_mode( true ),
@@ -87,17 +207,18 @@ DrawState::DrawState( int s_width, int s_height )
 }
 
 Framebuffer::Framebuffer( int s_width, int s_height )
-  : rows(), icon_name(), window_title(), bell_count( 0 ), title_initialized( false ), ds( s_width, s_height )
+  : rows(), first_row( 0 ), icon_name( make_shared<title_type>() ), window_title( make_shared<title_type>() ),
+    bell_count( 0 ), title_initialized( false ), ds( s_width, s_height )
 {
   assert( s_height > 0 );
   assert( s_width > 0 );
   const size_t w = s_width;
   const color_type c = 0;
-  rows = rows_type(s_height, row_pointer(make_shared<Row>( w, c )));
+  rows = make_shared<rows_type>( static_cast<size_t>( s_height ), RowPool::make_row( w, c ) );
 }
 
 Framebuffer::Framebuffer( const Framebuffer &other )
-  : rows( other.rows ), icon_name( other.icon_name ), window_title( other.window_title ),
+  : rows( other.rows ), first_row( other.first_row ), icon_name( other.icon_name ), window_title( other.window_title ),
     bell_count( other.bell_count ), title_initialized( other.title_initialized ), ds( other.ds )
 {
 }
@@ -106,6 +227,7 @@ Framebuffer & Framebuffer::operator=( const Framebuffer &other )
 {
   if ( this != &other ) {
     rows = other.rows;
+    first_row = other.first_row;
     icon_name =  other.icon_name;
     window_title = other.window_title;
     bell_count = other.bell_count;
@@ -209,26 +331,26 @@ Cell *Framebuffer::get_combining_cell( void )
 
 void DrawState::set_tab( void )
 {
-  tabs[ cursor_col ] = true;
+  writable_tabs()[ cursor_col ] = true;
 }
 
 void DrawState::clear_tab( int col )
 {
-  tabs[ col ] = false;
+  writable_tabs()[ col ] = false;
 }
 
 int DrawState::get_next_tab( int count ) const
 {
   if ( count >= 0 ) {
     for ( int i = cursor_col + 1; i < width; i++ ) {
-      if ( tabs[ i ] && --count == 0 ) {
+      if ( (*tabs)[ i ] && --count == 0 ) {
 	return i;
       }
     }
     return -1;
   } else {
     for ( int i = cursor_col - 1; i > 0; i-- ) {
-      if ( tabs[ i ] && ++count == 0 ) {
+      if ( (*tabs)[ i ] && ++count == 0 ) {
 	return i;
       }
     }
@@ -320,12 +442,18 @@ void Framebuffer::insert_line( int before_row, int count )
     return;
   }
 
-  // delete old rows
-  rows_type::iterator start = rows.begin() + ds.get_scrolling_region_bottom_row() + 1 - count;
-  rows.erase( start, start + count );
-  // insert new rows
-  start = rows.begin() + before_row;
-  rows.insert( start, count, newrow());
+  const int bottom = ds.get_scrolling_region_bottom_row();
+  if ( before_row == 0 && bottom + 1 == ds.get_height() ) {
+    // whole screen: rotate the buffer
+    first_row = ( first_row + rows->size() - count ) % rows->size();
+  } else {
+    // move rows down, leaving the ones pushed off the bottom at the top
+    rows_type &table = writable_rows();
+    for ( int i = bottom; i - count >= before_row; i-- ) {
+      table[ row_index( i ) ].swap( table[ row_index( i - count ) ] );
+    }
+  }
+  blank_rows( before_row, count );
 }
 
 void Framebuffer::delete_line( int row, int count )
@@ -344,58 +472,338 @@ void Framebuffer::delete_line( int row, int count )
     return;
   }
 
-  // delete old rows
-  rows_type::iterator start = rows.begin() + row;
-  rows.erase( start, start + count );
-  // insert a block of dummy rows
-  start = rows.begin() + ds.get_scrolling_region_bottom_row() + 1 - count;
-  rows.insert( start, count, newrow());
+  const int bottom = ds.get_scrolling_region_bottom_row();
+  if ( row == 0 && bottom + 1 == ds.get_height() ) {
+    // whole screen: rotate the buffer
+    first_row = ( first_row + count ) % rows->size();
+  } else {
+    // move rows up, leaving the deleted ones at the bottom
+    rows_type &table = writable_rows();
+    for ( int i = row; i + count <= bottom; i++ ) {
+      table[ row_index( i ) ].swap( table[ row_index( i + count ) ] );
+    }
+  }
+  blank_rows( bottom + 1 - count, count );
+}
+
+/* Clear rows that have scrolled in.  Rows nobody else holds are
+   reset where they are; the rest are replaced by a new blank row.
+   That row is about to be written, so it is not the interned one. */
+void Framebuffer::blank_rows( int row, int count )
+{
+  rows_type &table = writable_rows();
+  row_pointer blank;
+  for ( int i = row; i < row + count; i++ ) {
+    row_pointer &r = table[ row_index( i ) ];
+    if ( r.unique() ) {
+      reset_row( r.get() );
+    } else {
+      if ( blank.get() == NULL ) {
+	blank = RowPool::make_row( ds.get_width(), ds.get_background_rendition() );
+      }
+      r = blank;
+    }
+  }
+}
+
+void Framebuffer::intern_rows( void )
+{
+  if ( !RowPool::get_interning() ) {
+    return;
+  }
+  rows_type &table = writable_rows();
+  for ( rows_type::iterator i = table.begin(); i != table.end(); i++ ) {
+    *i = RowPool::intern( *i );
+  }
+}
+
+/* Put the rows back in display order, starting at rows[ 0 ]. */
+void Framebuffer::linearize_rows( void )
+{
+  if ( first_row != 0 ) {
+    rows_type &table = writable_rows();
+    std::rotate( table.begin(), table.begin() + first_row, table.end() );
+    first_row = 0;
+  }
+}
+
+Framebuffer::rows_type Framebuffer::get_rows() const
+{
+  rows_type ret;
+  ret.reserve( rows->size() );
+  ret.insert( ret.end(), rows->begin() + first_row, rows->end() );
+  ret.insert( ret.end(), rows->begin(), rows->begin() + first_row );
+  return ret;
+}
+
+bool Framebuffer::operator==( const Framebuffer &x ) const
+{
+  if ( rows->size() != x.rows->size() ) {
+    return false;
+  }
+  if ( rows != x.rows || first_row != x.first_row ) {
+    for ( int i = 0; i < static_cast<int>( rows->size() ); i++ ) {
+      if ( (*rows)[ row_index( i ) ] != (*x.rows)[ x.row_index( i ) ] ) {
+	return false;
+      }
+    }
+  }
+  return ( *window_title == *x.window_title ) && ( bell_count == x.bell_count ) && ( ds == x.ds );
 }
 
 Row::Row( const size_t s_width, const color_type background_color )
-  : cells( s_width, Cell( background_color ) ), gen( get_gen() )
+  : cells( s_width, Cell( background_color ) ), gen( get_gen() ),
+    id( new_id() ), parent( 0 ), damage_start( 0 ), damage_end( s_width ), older(),
+    content_hash( 0 ), hash_valid( false ), references( 0 ), interned( false )
 {}
 
+Row::Row( const Row &other )
+  : cells( other.cells ), gen( other.gen ),
+    id( new_id() ), parent( other.parent ), damage_start( other.damage_start ), damage_end( other.damage_end ), older(),
+    content_hash( other.content_hash ), hash_valid( other.hash_valid ), references( 0 ), interned( false )
+{
+  std::copy( other.older, other.older + OLDER_GENERATIONS, older );
+  rebase( other.id );
+}
+
 Row::Row() /* default constructor required by C++11 STL */
-  : cells( 1, Cell() ), gen( get_gen() )
+  : cells( 1, Cell() ), gen( get_gen() ),
+    id( new_id() ), parent( 0 ), damage_start( 0 ), damage_end( 1 ), older(),
+    content_hash( 0 ), hash_valid( false ), references( 0 ), interned( false )
 {
   assert( false );
 }
 
+/* As the constructors, but reusing the cells' storage */
+void Row::reinitialize( size_t s_width, color_type background_color )
+{
+  cells.assign( s_width, Cell( background_color ) );
+  gen = get_gen();
+  id = new_id();
+  parent = 0;
+  damage_start = 0;
+  damage_end = s_width;
+  for ( int i = 0; i < OLDER_GENERATIONS; i++ ) {
+    older[ i ].id = 0;
+  }
+  hash_valid = false;
+}
+
+void Row::reinitialize( const Row &other )
+{
+  cells = other.cells;
+  gen = other.gen;
+  id = new_id();
+  parent = other.parent;
+  damage_start = other.damage_start;
+  damage_end = other.damage_end;
+  std::copy( other.older, other.older + OLDER_GENERATIONS, older );
+  rebase( other.id );
+  content_hash = other.content_hash;
+  hash_valid = other.hash_valid;
+}
+
+/* parent becomes the most recent older generation, and everything
+   written since it counts as written since each older one too. */
+void Row::rebase( uint64_t new_parent )
+{
+  if ( new_parent == parent && damage_start >= damage_end ) {
+    return; /* nothing new to record */
+  }
+
+  for ( int i = OLDER_GENERATIONS - 1; i > 0; i-- ) {
+    older[ i ].id = older[ i - 1 ].id;
+    older[ i ].damage_start = std::min( older[ i - 1 ].damage_start, damage_start );
+    older[ i ].damage_end = std::max( older[ i - 1 ].damage_end, damage_end );
+  }
+  older[ 0 ].id = parent;
+  older[ 0 ].damage_start = damage_start;
+  older[ 0 ].damage_end = damage_end;
+
+  parent = new_parent;
+  damage_start = INT_MAX;
+  damage_end = 0;
+}
+
+bool Row::derived_from( const Row &x, int &start, int &end ) const
+{
+  if ( parent == x.id ) {
+    start = damage_start;
+    end = damage_end;
+    return true;
+  }
+
+  for ( int i = 0; i < OLDER_GENERATIONS; i++ ) {
+    if ( older[ i ].id == x.id ) {
+      start = std::min( older[ i ].damage_start, damage_start );
+      end = std::max( older[ i ].damage_end, damage_end );
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* The free list, emptied when the program exits */
+class FreeRows {
+public:
+  std::vector<Row *> rows;
+
+  FreeRows() : rows() {}
+  ~FreeRows()
+  {
+    for ( std::vector<Row *>::iterator i = rows.begin(); i != rows.end(); i++ ) {
+      delete *i;
+    }
+  }
+};
+
+static std::vector<Row *> & free_rows( void )
+{
+  static FreeRows free;
+  return free.rows;
+}
+
+RowPointer RowPool::make_row( size_t width, color_type background_color )
+{
+  std::vector<Row *> &pool = free_rows();
+  if ( pool.empty() ) {
+    return RowPointer( new Row( width, background_color ) );
+  }
+  Row *row = pool.back();
+  pool.pop_back();
+  row->reinitialize( width, background_color );
+  return RowPointer( row );
+}
+
+RowPointer RowPool::copy_row( const Row &other )
+{
+  std::vector<Row *> &pool = free_rows();
+  if ( pool.empty() ) {
+    return RowPointer( new Row( other ) );
+  }
+  Row *row = pool.back();
+  pool.pop_back();
+  row->reinitialize( other );
+  return RowPointer( row );
+}
+
+typedef std::map<uint64_t, Row *> intern_table_type;
+
+static intern_table_type & intern_table( void )
+{
+  static intern_table_type table;
+  return table;
+}
+
+bool RowPool::interning = false;
+
+RowPointer RowPool::blank_row( size_t width, color_type background_color )
+{
+  return intern( make_row( width, background_color ) );
+}
+
+RowPointer RowPool::intern( const RowPointer &row )
+{
+  if ( !interning || row->interned ) {
+    return row;
+  }
+  std::pair<intern_table_type::iterator, bool> entry =
+    intern_table().insert( std::make_pair( row->hash(), row.get() ) );
+  if ( entry.second ) {
+    row->interned = true;
+    row->references++;
+    return row;
+  }
+  /* Rows whose hashes collide stay as they are. */
+  const Row &existing = *entry.first->second;
+  if ( existing.cells.size() == row->cells.size()
+       && memcmp( &existing.cells[ 0 ], &row->cells[ 0 ], row->cells.size() * sizeof( Cell ) ) == 0 ) {
+    /* Whoever keeps the original can still diff against the shared row. */
+    row->rebase( existing.id );
+    return RowPointer( entry.first->second );
+  }
+  return row;
+}
+
+void RowPool::recycle( Row *row )
+{
+  if ( row->interned ) {
+    intern_table().erase( row->hash() );
+    row->interned = false;
+    row->references = 0;
+  }
+
+  std::vector<Row *> &pool = free_rows();
+  if ( pool.size() < MAX_FREE_ROWS ) {
+    pool.push_back( row );
+  } else {
+    delete row;
+  }
+}
+
 uint64_t Row::get_gen() const
 {
   static uint64_t gen_counter = 0;
   return gen_counter++;
 }
 
+uint64_t Row::new_id( void )
+{
+  static uint64_t id_counter = 0;
+  return ++id_counter; /* 0 is never an id, so rows without a parent match nothing */
+}
+
+/* Cells compare with memcmp(), so hash their bytes, a word at a time. */
+void Row::compute_hash( void ) const
+{
+  const uint64_t multiplier = 0x9e3779b97f4a7c15ULL;
+  uint64_t h = cells.size();
+  const char *p = reinterpret_cast<const char *>( &cells[ 0 ] );
+  size_t len = cells.size() * sizeof( Cell );
+  while ( len > 0 ) {
+    uint64_t word = 0;
+    const size_t n = std::min( len, sizeof( word ) );
+    memcpy( &word, p, n );
+    h = ( ( ( h << 5 ) | ( h >> 59 ) ) ^ word ) * multiplier;
+    p += n;
+    len -= n;
+  }
+  content_hash = h;
+  hash_valid = true;
+}
+
 void Row::insert_cell( int col, color_type background_color )
 {
+  damage( col, cells.size() );
   cells.insert( cells.begin() + col, Cell( background_color ) );
   cells.pop_back();
 }
 
 void Row::delete_cell( int col, color_type background_color )
 {
+  damage( col, cells.size() );
   cells.push_back( Cell( background_color ) );
   cells.erase( cells.begin() + col );
 }
 
 void Framebuffer::insert_cell( int row, int col )
 {
-  get_mutable_row( row )->insert_cell( col, ds.get_background_rendition() );
+  get_mutable_row( row, col, ds.get_width() )->insert_cell( col, ds.get_background_rendition() );
 }
 
 void Framebuffer::delete_cell( int row, int col )
 {
-  get_mutable_row( row )->delete_cell( col, ds.get_background_rendition() );
+  get_mutable_row( row, col, ds.get_width() )->delete_cell( col, ds.get_background_rendition() );
 }
 
 void Framebuffer::reset( void )
 {
   int width = ds.get_width(), height = ds.get_height();
   ds = DrawState( width, height );
-  rows = rows_type( height, newrow() );
-  window_title.clear();
+  rows = make_shared<rows_type>( static_cast<size_t>( height ), newrow() );
+  first_row = 0;
+  window_title = make_shared<title_type>();
   /* do not reset bell_count */
 }
 
@@ -419,19 +827,22 @@ void Framebuffer::resize( int s_width, int s_height )
   int oldwidth = ds.get_width();
   ds.resize( s_width, s_height );
 
+  linearize_rows();
+  rows_type &table = writable_rows();
   row_pointer blankrow( newrow());
   if ( oldheight != s_height ) {
-    rows.resize( s_height, blankrow );
+    table.resize( s_height, blankrow );
   }
   if (oldwidth == s_width) {
     return;
   }
-  for ( rows_type::iterator i = rows.begin();
-	i != rows.end() && *i != blankrow;
-	i++ ) {
-    *i = make_shared<Row>( **i );
+  /* Blank rows are shared, so stop at the ones just added by position. */
+  const rows_type::iterator added = table.begin() + std::min( oldheight, s_height );
+  for ( rows_type::iterator i = table.begin(); i != added; i++ ) {
+    *i = RowPool::copy_row( **i );
     (*i)->set_wrap( false );
     (*i)->cells.resize( s_width, Cell( ds.get_background_rendition() ) );
+    (*i)->damage( 0, s_width );
   }
 }
 
@@ -446,7 +857,7 @@ void DrawState::resize( int s_width, int s_height )
     scrolling_region_bottom_row = s_height - 1;
   }
 
-  tabs.resize( s_width );
+  writable_tabs().resize( s_width );
   if ( default_tabs ) {
     reinitialize_tabs( width );
   }
@@ -570,28 +981,111 @@ std::string Renditions::sgr( void ) const
   return ret;
 }
 
+/* Parameters for a color: the 8-color set in the main SGR, and the
+   256-color set in a sequence of its own, as sgr() does. */
+static void append_color( std::string &params, std::string &extended,
+			  unsigned int color, unsigned int base )
+{
+  char col[ 64 ];
+  if ( color == 0 ) {
+    snprintf( col, 64, ";%u", base + 9 );
+    params.append( col );
+  } else if ( color <= base + 7 ) {
+    snprintf( col, 64, ";%u", color );
+    params.append( col );
+  } else {
+    snprintf( col, 64, "\033[%u;5;%um", base + 8, color - base );
+    extended.append( col );
+  }
+}
+
+std::string Renditions::sgr_change( const Renditions &from ) const
+{
+  static const struct {
+    attribute_type attr;
+    const char *on, *off;
+  } codes[] = {
+    { bold, ";1", ";22" },
+    { italic, ";3", ";23" },
+    { underlined, ";4", ";24" },
+    { blink, ";5", ";25" },
+    { inverse, ";7", ";27" },
+    { invisible, ";8", ";28" },
+  };
+
+  std::string params, extended;
+  for ( size_t i = 0; i < sizeof( codes ) / sizeof( codes[ 0 ] ); i++ ) {
+    if ( get_attribute( codes[ i ].attr ) != from.get_attribute( codes[ i ].attr ) ) {
+      params.append( get_attribute( codes[ i ].attr ) ? codes[ i ].on : codes[ i ].off );
+    }
+  }
+  if ( foreground_color != from.foreground_color ) {
+    append_color( params, extended, foreground_color, 30 );
+  }
+  if ( background_color != from.background_color ) {
+    append_color( params, extended, background_color, 40 );
+  }
+
+  std::string ret;
+  if ( !params.empty() ) {
+    ret.append( "\033[" );
+    ret.append( params, 1, std::string::npos );
+    ret.append( "m" );
+  }
+  ret.append( extended );
+
+  /* Starting over can be shorter, e.g. when turning everything off. */
+  std::string reset = sgr();
+  return reset.size() < ret.size() ? reset : ret;
+}
+
+std::string Renditions::sgr( const Renditions &from ) const
+{
+  /* Direct-mapped: a screen uses few renditions, and switches
+     between the same pairs over and over. */
+  struct Entry {
+    uint64_t key;
+    std::string sgr;
+    Entry() : key( 0 ), sgr() {}
+  };
+  static const size_t CACHE_SIZE = 256;
+  static Entry cache[ CACHE_SIZE ];
+
+  if ( *this == from ) {
+    return std::string();
+  }
+
+  /* A change never maps a rendition to itself, so key 0 is free. */
+  const uint64_t pair = ( uint64_t( from.key() ) << 32 ) | key();
+  Entry &entry = cache[ ( ( pair * 0x9E3779B97F4A7C15ULL ) >> 32 ) % CACHE_SIZE ];
+  if ( entry.key != pair ) {
+    entry.key = pair;
+    entry.sgr = sgr_change( from );
+  }
+  return entry.sgr;
+}
+
 void Row::reset( color_type background_color )
 {
   gen = get_gen();
-  for ( cells_type::iterator i = cells.begin();
-	i != cells.end();
-	i++ ) {
-    i->reset( background_color );
-  }
+  damage( 0, cells.size() );
+  std::fill( cells.begin(), cells.end(), Cell( background_color ) );
 }
 
 void Framebuffer::prefix_window_title( const title_type &s )
 {
-  if ( icon_name == window_title ) {
+  title_type title( s );
+  title.insert( title.end(), window_title->begin(), window_title->end() );
+  if ( *icon_name == *window_title ) {
     /* preserve equivalence */
-    icon_name.insert(icon_name.begin(), s.begin(), s.end() );
+    icon_name = make_shared<title_type>( title );
   }
-  window_title.insert(window_title.begin(), s.begin(), s.end() );
+  window_title = make_shared<title_type>( title );
 }
 
 std::string Cell::debug_contents( void ) const
 {
-  if ( contents.empty() ) {
+  if ( empty() ) {
     return "'_' ()";
   } else {
     std::string chars( 1, '\'' );
@@ -599,11 +1093,10 @@ std::string Cell::debug_contents( void ) const
     chars.append( "' [" );
     const char *lazycomma = "";
     char buf[64];
-    for ( content_type::const_iterator i = contents.begin();
-	  i < contents.end();
-	  i++ ) {
+    const char *data = contents_data();
+    for ( size_t i = 0; i < length; i++ ) {
 
-      snprintf( buf, sizeof buf, "%s0x%02x", lazycomma, static_cast<uint8_t>(*i) );
+      snprintf( buf, sizeof buf, "%s0x%02x", lazycomma, static_cast<uint8_t>( data[ i ] ) );
       chars.append( buf );
       lazycomma = ", ";
     }
@@ -631,21 +1124,21 @@ bool Cell::compare( const Cell &other ) const
     // ret = true;
     fprintf( stderr, "Contents: %s (%ld) vs. %s (%ld)\n",
 	     debug_contents().c_str(),
-	     static_cast<long int>( contents.size() ),
+	     static_cast<long int>( length ),
 	     other.debug_contents().c_str(),
-	     static_cast<long int>( other.contents.size() ) );
+	     static_cast<long int>( other.length ) );
   }
 
-  if ( fallback != other.fallback ) {
+  if ( get_fallback() != other.get_fallback() ) {
     // ret = true;
     fprintf( stderr, "fallback: %d vs. %d\n",
-	     fallback, other.fallback );
+	     get_fallback(), other.get_fallback() );
   }
 
-  if ( wide != other.wide ) {
+  if ( get_wide() != other.get_wide() ) {
     ret = true;
     fprintf( stderr, "width: %d vs. %d\n",
-	     wide, other.wide );
+	     get_wide(), other.get_wide() );
   }
 
   if ( !(renditions == other.renditions) ) {
@@ -653,10 +1146,10 @@ bool Cell::compare( const Cell &other ) const
     fprintf( stderr, "renditions differ\n" );
   }
 
-  if ( wrap != other.wrap ) {
+  if ( get_wrap() != other.get_wrap() ) {
     ret = true;
     fprintf( stderr, "wrap: %d vs. %d\n",
-	     wrap, other.wrap );
+	     get_wrap(), other.get_wrap() );
   }
 
   return ret;
@@ -36,6 +36,7 @@
 #include <assert.h>
 #include <limits.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <vector>
 #include <deque>
@@ -67,6 +68,9 @@ namespace Terminal {
     void set_background_color( int num );
     void set_rendition( color_type num );
     std::string sgr( void ) const;
+    /* The shortest sequence that changes the rendition from "from"
+       to this one.  Recent answers are remembered. */
+    std::string sgr( const Renditions &from ) const;
 
     bool operator==( const Renditions &x ) const
     {
@@ -82,30 +86,125 @@ namespace Terminal {
     }
     bool get_attribute( attribute_type attr ) const { return attributes & ( 1 << attr ); }
     void clear_attributes() { attributes = 0; }
+
+  private:
+    uint32_t key( void ) const { return (foreground_color << 20) | (background_color << 8) | attributes; }
+    std::string sgr_change( const Renditions &from ) const;
   };
 
+  static const size_t UTF8_MAX = 4;
+
+  /* Encode c as UTF-8 into buf, which must have room for UTF8_MAX
+     bytes, and return the number of bytes written.  Unlike wcrtomb(),
+     this does not depend on the locale.  Surrogates and values past
+     U+10FFFF, which cannot be encoded, become U+FFFD. */
+  inline size_t utf8_encode( const wchar_t wc, char *buf )
+  {
+    uint32_t c = wc;
+
+    if ( c < 0x80 ) {
+      buf[ 0 ] = static_cast<char>( c );
+      return 1;
+    }
+    if ( c < 0x800 ) {
+      buf[ 0 ] = static_cast<char>( 0xC0 | (c >> 6) );
+      buf[ 1 ] = static_cast<char>( 0x80 | (c & 0x3F) );
+      return 2;
+    }
+    if ( c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF) ) {
+      c = 0xFFFD;
+    }
+    if ( c < 0x10000 ) {
+      buf[ 0 ] = static_cast<char>( 0xE0 | (c >> 12) );
+      buf[ 1 ] = static_cast<char>( 0x80 | ((c >> 6) & 0x3F) );
+      buf[ 2 ] = static_cast<char>( 0x80 | (c & 0x3F) );
+      return 3;
+    }
+    buf[ 0 ] = static_cast<char>( 0xF0 | (c >> 18) );
+    buf[ 1 ] = static_cast<char>( 0x80 | ((c >> 12) & 0x3F) );
+    buf[ 2 ] = static_cast<char>( 0x80 | ((c >> 6) & 0x3F) );
+    buf[ 3 ] = static_cast<char>( 0x80 | (c & 0x3F) );
+    return 4;
+  }
+
   class Cell {
   private:
-    typedef std::string content_type; /* can be std::string, std::vector<uint8_t>, or __gnu_cxx::__vstring */
-    content_type contents;
+    /* Contents are UTF-8, stored inline when they fit, as nearly all
+       do.  Longer combining sequences are interned in a side table
+       and the cell holds their index, so a Cell is a fixed-size value
+       that can be compared with memcmp.  Each copy of such a cell
+       holds a reference to its entry, which is freed with the last. */
+    static const size_t INLINE_SIZE = 10;
+    /* 32 seems like a reasonable limit on combining characters */
+    static const size_t MAX_CONTENTS = 32;
+
+    enum {
+      WIDE = 1 << 0, /* 0 = narrow, 1 = wide */
+      FALLBACK = 1 << 1, /* first character is combining character */
+      WRAP = 1 << 2,
+      INTERNED = 1 << 3 /* contents holds an index into the side table */
+    };
+
     Renditions renditions;
-    unsigned int wide : 1; /* 0 = narrow, 1 = wide */
-    unsigned int fallback : 1; /* first character is combining character */
-    unsigned int wrap : 1;
+    unsigned char flags;
+    unsigned char length; /* of the contents, in bytes */
+    char contents[ INLINE_SIZE ]; /* unused bytes are always zero */
+
+    const char *contents_data( void ) const;
+    void append_interned( const char *s, size_t len );
+    void retain_interned( void ) const;
+    void release_interned( void );
+
+    void set_flag( unsigned char flag, bool val )
+    {
+      flags = val ? ( flags | flag ) : ( flags & ~flag );
+    }
 
   public:
     Cell( color_type background_color );
     Cell(); /* default constructor required by C++11 STL */
 
+    Cell( const Cell &x )
+      : renditions( x.renditions ),
+	flags( x.flags ),
+	length( x.length )
+    {
+      memcpy( contents, x.contents, sizeof( contents ) );
+      if ( flags & INTERNED ) {
+	retain_interned();
+      }
+    }
+
+    Cell & operator=( const Cell &x )
+    {
+      if ( this == &x ) {
+	return *this;
+      }
+      if ( x.flags & INTERNED ) {
+	x.retain_interned();
+      }
+      if ( flags & INTERNED ) {
+	release_interned();
+      }
+      renditions = x.renditions;
+      flags = x.flags;
+      length = x.length;
+      memcpy( contents, x.contents, sizeof( contents ) );
+      return *this;
+    }
+
+    ~Cell()
+    {
+      if ( flags & INTERNED ) {
+	release_interned();
+      }
+    }
+
     void reset( color_type background_color );
 
     bool operator==( const Cell &x ) const
     {
-      return ( (contents == x.contents)
-	       && (fallback == x.fallback)
-	       && (wide == x.wide)
-	       && (renditions == x.renditions)
-	       && (wrap == x.wrap) );
+      return memcmp( this, &x, sizeof( Cell ) ) == 0;
     }
 
     bool operator!=( const Cell &x ) const { return !operator==( x ); }
@@ -113,66 +212,83 @@ namespace Terminal {
     /* Accessors for contents field */
     std::string debug_contents( void ) const;
 
-    bool empty( void ) const { return contents.empty(); }
-    /* 32 seems like a reasonable limit on combining characters */
-    bool full( void ) const { return contents.size() >= 32; }
-    void clear( void ) { contents.clear(); }
+    bool empty( void ) const { return length == 0; }
+    bool full( void ) const { return length >= MAX_CONTENTS; }
+    void clear( void )
+    {
+      if ( flags & INTERNED ) {
+	release_interned();
+      }
+      flags &= ~INTERNED;
+      length = 0;
+      memset( contents, 0, sizeof( contents ) );
+    }
 
     bool is_blank( void ) const
     {
       // XXX fix.
-      return ( contents.empty()
-	       || contents == " "
-	       || contents == "\xC2\xA0" );
+      return ( length == 0
+	       || ( length == 1 && contents[ 0 ] == ' ' )
+	       || ( length == 2 && contents[ 0 ] == '\xC2' && contents[ 1 ] == '\xA0' ) );
     }
 
-    bool contents_match ( const Cell &other ) const
+    /* Is the contents one character, with nothing combined? */
+    bool single_character( void ) const
     {
-      return ( is_blank() && other.is_blank() )
-             || ( contents == other.contents );
+      if ( length == 0 || ( flags & ( FALLBACK | INTERNED ) ) ) {
+	return false;
+      }
+      const unsigned char lead = contents[ 0 ];
+      const size_t lead_length = lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+      return length == lead_length;
     }
 
-    bool compare( const Cell &other ) const;
+    /* Bytes written by print_grapheme() */
+    size_t grapheme_size( void ) const
+    {
+      return length ? length + ( ( flags & FALLBACK ) ? 2 : 0 ) : 1;
+    }
 
-    // Is this a printing ISO 8859-1 character?
-    static bool isprint_iso8859_1( const wchar_t c )
+    bool contents_match ( const Cell &other ) const
     {
-      return ( c <= 0xff && c >= 0xa0 ) || ( c <= 0x7e && c >= 0x20 );
+      return ( is_blank() && other.is_blank() )
+             || ( length == other.length
+		  && memcmp( contents, other.contents, sizeof( contents ) ) == 0 );
     }
 
-   static void append_to_str( std::string &dest, const wchar_t c )
+    bool compare( const Cell &other ) const;
+
+    static void append_to_str( std::string &dest, const wchar_t c )
     {
       /* ASCII?  Cheat. */
       if ( static_cast<uint32_t>(c) <= 0x7f ) {
 	dest.push_back( static_cast<char>(c) );
 	return;
       }
-      static mbstate_t ps = mbstate_t();
-      char tmp[MB_LEN_MAX];
-      size_t ignore = wcrtomb(NULL, 0, &ps);
-      (void)ignore;
-      size_t len = wcrtomb(tmp, c, &ps);
-      dest.append( tmp, len );
+      char tmp[ UTF8_MAX ];
+      dest.append( tmp, utf8_encode( c, tmp ) );
     }
 
     void append( const wchar_t c )
     {
       /* ASCII?  Cheat. */
-      if ( static_cast<uint32_t>(c) <= 0x7f ) {
-	contents.push_back( static_cast<char>(c) );
+      if ( static_cast<uint32_t>(c) <= 0x7f && length < INLINE_SIZE ) {
+	contents[ length++ ] = static_cast<char>(c);
+	return;
+      }
+      char tmp[ UTF8_MAX ];
+      size_t len = utf8_encode( c, tmp );
+      if ( !( flags & INTERNED ) && length + len <= INLINE_SIZE ) {
+	memcpy( contents + length, tmp, len );
+	length += len;
 	return;
       }
-      static mbstate_t ps = mbstate_t();
-      char tmp[MB_LEN_MAX];
-      size_t ignore = wcrtomb(NULL, 0, &ps);
-      (void)ignore;
-      size_t len = wcrtomb(tmp, c, &ps);
-      contents.insert( contents.end(), tmp, tmp+len );
+      append_interned( tmp, len );
     }
 
     void print_grapheme( std::string &output ) const
     {
-      if ( contents.empty() ) {
+      if ( length == 0 ) {
 	output.append( 1, ' ' );
 	return;
       }
@@ -180,23 +296,23 @@ namespace Terminal {
        * cells that begin with combining character get combiner
        * attached to no-break space
        */
-      if ( fallback ) {
+      if ( flags & FALLBACK ) {
 	output.append( "\xC2\xA0" );
       }
-      output.append( contents );
+      output.append( contents_data(), length );
     }
 
     /* Other accessors */
     const Renditions& get_renditions( void ) const { return renditions; }
     Renditions& get_renditions( void ) { return renditions; }
     void set_renditions( const Renditions& r ) { renditions = r; }
-    bool get_wide( void ) const { return wide; }
-    void set_wide( bool w ) { wide = w; }
-    unsigned int get_width( void ) const { return wide + 1; }
-    bool get_fallback( void ) const { return fallback; }
-    void set_fallback( bool f ) { fallback = f; }
-    bool get_wrap( void ) const { return wrap; }
-    void set_wrap( bool f ) { wrap = f; }
+    bool get_wide( void ) const { return flags & WIDE; }
+    void set_wide( bool w ) { set_flag( WIDE, w ); }
+    unsigned int get_width( void ) const { return get_wide() + 1; }
+    bool get_fallback( void ) const { return flags & FALLBACK; }
+    void set_fallback( bool f ) { set_flag( FALLBACK, f ); }
+    bool get_wrap( void ) const { return flags & WRAP; }
+    void set_wrap( bool f ) { set_flag( WRAP, f ); }
   };
 
   class Row {
@@ -208,25 +324,173 @@ namespace Terminal {
     // in scrolling.
     uint64_t gen;
 
+    // id names the current contents of this Row object; it changes
+    // whenever the row is written in place.  A copy records the id of
+    // the row it was copied from in parent, and the columns written
+    // since then in [damage_start, damage_end), so that a diff
+    // against that row need only look at those columns.
+    uint64_t id, parent;
+    int damage_start, damage_end;
+
+  private:
+    // The rows before parent, most recent first, each with the
+    // columns written between it and parent.  This journal lets a diff
+    // against a state several sends old stay as small as the edits.
+    struct Generation {
+      uint64_t id;
+      int damage_start, damage_end;
+    };
+    static const int OLDER_GENERATIONS = 3;
+    Generation older[ OLDER_GENERATIONS ];
+
+    /* Record that the contents equal those of the row named new_parent. */
+    void rebase( uint64_t new_parent );
+
+    // Hash of the cells, computed on first use after a write, so that
+    // rows that differ can usually be told apart without comparing
+    // every cell.
+    mutable uint64_t content_hash;
+    mutable bool hash_valid;
+
+    void compute_hash( void ) const;
+
+    Row &operator=( const Row & ); /* not assignable: ids must stay unique */
+
+    friend class RowPointer;
+    friend class RowPool;
+    unsigned int references;
+    bool interned; /* held by the intern table, which counts as a reference */
+
+    /* Make a recycled row like one just constructed. */
+    void reinitialize( size_t s_width, color_type background_color );
+    void reinitialize( const Row &other );
+
+  public:
     Row( const size_t s_width, const color_type background_color );
+    Row( const Row &other );
     Row(); /* default constructor required by C++11 STL */
 
+    /* Record a write to columns [start, end).  Anyone writing to
+       cells directly must call this. */
+    inline void damage( int start, int end )
+    {
+      id = new_id();
+      hash_valid = false;
+      if ( start < damage_start ) damage_start = start;
+      if ( end > damage_end ) damage_end = end;
+    }
+
+    /* True if this row descends from x, differing from it at most in
+       columns [start, end). */
+    bool derived_from( const Row &x, int &start, int &end ) const;
+
     void insert_cell( int col, color_type background_color );
     void delete_cell( int col, color_type background_color );
 
     void reset( color_type background_color );
 
+    inline uint64_t hash( void ) const
+    {
+      if ( !hash_valid ) {
+	compute_hash();
+      }
+      return content_hash;
+    }
+
     bool operator==( const Row &x ) const
     {
-      return ( gen == x.gen && cells == x.cells );
+      return ( this == &x )
+	|| ( ( gen == x.gen )
+	     && ( cells.size() == x.cells.size() )
+	     && ( hash() == x.hash() )
+	     && ( memcmp( &cells[ 0 ], &x.cells[ 0 ], cells.size() * sizeof( Cell ) ) == 0 ) );
     }
 
     bool get_wrap( void ) const { return cells.back().get_wrap(); }
-    void set_wrap( bool w ) { cells.back().set_wrap( w ); }
+    void set_wrap( bool w )
+    {
+      damage( cells.size() - 1, cells.size() );
+      cells.back().set_wrap( w );
+    }
 
     uint64_t get_gen() const;
+    static uint64_t new_id( void );
+  };
+
+  class RowPool;
+
+  /* A reference to a Row, counted in the row itself.  A terminal's
+     state is only touched by one thread, so unlike shared_ptr the
+     count is not atomic.  Copying a Framebuffer copies one of these
+     per row. */
+  class RowPointer {
+  private:
+    Row *row;
+
+    inline void release( void );
+
+  public:
+    inline RowPointer() : row( NULL ) {}
+    inline explicit RowPointer( Row *s_row ) : row( s_row ) { if ( row ) row->references++; }
+    inline RowPointer( const RowPointer &other ) : row( other.row ) { if ( row ) row->references++; }
+    inline ~RowPointer() { release(); }
+
+    inline RowPointer &operator=( const RowPointer &other )
+    {
+      if ( other.row ) other.row->references++;
+      release();
+      row = other.row;
+      return *this;
+    }
+
+    inline void swap( RowPointer &other ) { std::swap( row, other.row ); }
+
+    inline Row *get( void ) const { return row; }
+    inline Row &operator*( void ) const { return *row; }
+    inline Row *operator->( void ) const { return row; }
+    inline bool unique( void ) const { return row->references == 1; }
+
+    inline bool operator==( const RowPointer &x ) const { return row == x.row; }
+    inline bool operator!=( const RowPointer &x ) const { return row != x.row; }
+  };
+
+  inline void swap( RowPointer &a, RowPointer &b ) { a.swap( b ); }
+
+  /* Rows that are no longer referenced, kept with their cells for
+     reuse.  A terminal makes and drops rows at a steady rate as it
+     scrolls and as old states are thrown away, so most new rows can
+     be had without touching the heap.
+
+     If interning is turned on, the pool also interns rows: intern()
+     returns the one row kept for each distinct content, so that the
+     states a session holds share storage for their equal rows, and
+     every new blank row is the shared one.  An interned row is never
+     unique, so it is copied before any write, and it leaves the table
+     when nothing else refers to it.  Interning is off by default. */
+  class RowPool {
+  private:
+    static const size_t MAX_FREE_ROWS = 256;
+    static bool interning;
+
+  public:
+    static void set_interning( bool s_interning ) { interning = s_interning; }
+    static bool get_interning( void ) { return interning; }
+
+    static RowPointer make_row( size_t width, color_type background_color );
+    static RowPointer copy_row( const Row &other );
+    static RowPointer blank_row( size_t width, color_type background_color );
+    static RowPointer intern( const RowPointer &row );
+    static void recycle( Row *row );
   };
 
+  inline void RowPointer::release( void )
+  {
+    if ( row && --row->references <= static_cast<unsigned int>( row->interned ) ) {
+      RowPool::recycle( row );
+    }
+    row = NULL;
+  }
+
   class SavedCursor {
   public:
     int cursor_col, cursor_row;
@@ -250,8 +514,10 @@ namespace Terminal {
     int combining_char_col, combining_char_row;
 
     bool default_tabs;
-    std::vector<bool> tabs;
+    /* shared between copies until one of them changes the tab stops */
+    shared_ptr< std::vector<bool> > tabs;
 
+    std::vector<bool> &writable_tabs( void );
     void reinitialize_tabs( unsigned int start );
 
     int scrolling_region_top_row, scrolling_region_bottom_row;
@@ -344,11 +610,12 @@ namespace Terminal {
   };
 
   class Framebuffer {
-    // To minimize copying of rows and cells, we use shared_ptr to
-    // share unchanged rows between multiple Framebuffers.  If we
-    // write to a row in a Framebuffer and it is shared with other
-    // owners, we copy it first.  The shared_ptr naturally manages the
-    // usage of the actual rows themselves.
+    // To minimize copying of rows and cells, we use reference
+    // counted RowPointers to share unchanged rows between multiple
+    // Framebuffers.  If we write to a row in a Framebuffer and it is
+    // shared with other owners, we copy it first.  The reference
+    // count naturally manages the usage of the actual rows
+    // themselves.
     //
     // We gain a couple of free extras by doing this:
     //
@@ -356,15 +623,26 @@ namespace Terminal {
     // Framebuffers is to simply compare the pointer values.  If they
     // are equal, then the rows are obviously identical.
     // * If no row is shared, the frame has not been modified.
+    //
+    // The rows are kept in a circular buffer, so that scrolling the
+    // whole screen only moves the index of the top row.
+    //
+    // The table of rows, and the titles, are shared in turn between
+    // copies of a Framebuffer until one of them changes.  Copying a
+    // Framebuffer, as the transport does for every state it keeps,
+    // then costs the same whatever the size of the screen, and a
+    // later change pays for copying the table of row pointers and
+    // the rows it writes.
   public:
     typedef std::vector<wchar_t> title_type;
-    typedef shared_ptr<Row> row_pointer;
+    typedef RowPointer row_pointer;
     typedef std::vector<row_pointer> rows_type; /* can be either std::vector or std::deque */
 
   private:
-    rows_type rows;
-    title_type icon_name;
-    title_type window_title;
+    shared_ptr<rows_type> rows; /* circular; logical row 0 is (*rows)[ first_row ] */
+    size_t first_row;
+    shared_ptr<title_type> icon_name;
+    shared_ptr<title_type> window_title;
     unsigned int bell_count;
     bool title_initialized; /* true if the window title has been set via an OSC */
 
@@ -372,16 +650,40 @@ namespace Terminal {
     {
       const size_t w = ds.get_width();
       const color_type c = ds.get_background_rendition();
-      return make_shared<Row>( w, c );
+      return RowPool::blank_row( w, c );
+    }
+
+    /* Position in rows of a logical row.  Rows out of range map
+       past the end, so that at() still catches them. */
+    inline size_t row_index( int row ) const
+    {
+      const size_t size = rows->size();
+      if ( static_cast<size_t>( row ) >= size ) {
+	return size;
+      }
+      size_t i = first_row + row;
+      return i < size ? i : i - size;
+    }
+
+    /* The row table, copied first if it is shared. */
+    inline rows_type &writable_rows( void )
+    {
+      if ( rows.use_count() != 1 ) {
+	rows = make_shared<rows_type>( *rows );
+      }
+      return *rows;
     }
 
+    void blank_rows( int row, int count );
+    void linearize_rows( void );
+
   public:
     Framebuffer( int s_width, int s_height );
     Framebuffer( const Framebuffer &other );
     Framebuffer &operator=( const Framebuffer &other );
     DrawState ds;
 
-    const rows_type &get_rows() const { return rows; }
+    rows_type get_rows() const; /* in display order */
 
     void scroll( int N );
     void move_rows_autoscroll( int rows );
@@ -390,7 +692,7 @@ namespace Terminal {
     {
       if ( row == -1 ) row = ds.get_cursor_row();
 
-      return rows.at( row ).get();
+      return rows->at( row_index( row ) ).get();
     }
 
     inline const Cell *get_cell( int row = -1, int col = -1 ) const
@@ -398,32 +700,48 @@ namespace Terminal {
       if ( row == -1 ) row = ds.get_cursor_row();
       if ( col == -1 ) col = ds.get_cursor_col();
 
-      return &rows.at( row )->cells.at( col );
+      return &rows->at( row_index( row ) )->cells.at( col );
     }
 
-    Row *get_mutable_row( int row )
+    /* Row for writing, copied first if it is shared.  Columns
+       [start_col, end_col) are recorded as damaged. */
+    Row *get_mutable_row( int row, int start_col, int end_col )
     {
       if ( row == -1 ) row = ds.get_cursor_row();
-      row_pointer &mutable_row = rows.at( row );
+      row_pointer &mutable_row = writable_rows().at( row_index( row ) );
       // If the row is shared, copy it.
       if (!mutable_row.unique()) {
-	mutable_row = make_shared<Row>( *mutable_row );
+	mutable_row = RowPool::copy_row( *mutable_row );
       }
+      mutable_row->damage( start_col, end_col );
       return mutable_row.get();
     }
 
+    Row *get_mutable_row( int row )
+    {
+      return get_mutable_row( row, 0, ds.get_width() );
+    }
+
+    void set_wrap( int row, bool w )
+    {
+      get_mutable_row( row, ds.get_width() - 1, ds.get_width() )->set_wrap( w );
+    }
+
     Cell *get_mutable_cell( int row = -1, int col = -1 )
     {
       if ( row == -1 ) row = ds.get_cursor_row();
       if ( col == -1 ) col = ds.get_cursor_col();
 
-      return &get_mutable_row( row )->cells.at( col );
+      return &get_mutable_row( row, col, col + 1 )->cells.at( col );
     }
 
     Cell *get_combining_cell( void );
 
     void apply_renditions_to_cell( Cell *cell );
 
+    /* Replace rows with the interned ones of the same content. */
+    void intern_rows( void );
+
     void insert_line( int before_row, int count );
     void delete_line( int row, int count );
 
@@ -435,10 +753,10 @@ namespace Terminal {
 
     void set_title_initialized( void ) { title_initialized = true; }
     bool is_title_initialized( void ) const { return title_initialized; }
-    void set_icon_name( const title_type &s ) { icon_name = s; }
-    void set_window_title( const title_type &s ) { window_title = s; }
-    const title_type & get_icon_name( void ) const { return icon_name; }
-    const title_type & get_window_title( void ) const { return window_title; }
+    void set_icon_name( const title_type &s ) { icon_name = make_shared<title_type>( s ); }
+    void set_window_title( const title_type &s ) { window_title = make_shared<title_type>( s ); }
+    const title_type & get_icon_name( void ) const { return *icon_name; }
+    const title_type & get_window_title( void ) const { return *window_title; }
 
     void prefix_window_title( const title_type &s );
 
@@ -450,10 +768,7 @@ namespace Terminal {
     void ring_bell( void ) { bell_count++; }
     unsigned int get_bell_count( void ) const { return bell_count; }
 
-    bool operator==( const Framebuffer &x ) const
-    {
-      return ( rows == x.rows ) && ( window_title == x.window_title ) && ( bell_count == x.bell_count ) && ( ds == x.ds );
-    }
+    bool operator==( const Framebuffer &x ) const;
   };
 }
 
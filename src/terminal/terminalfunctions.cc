@@ -31,6 +31,7 @@
 */
 
 #include <unistd.h>
+#include <stdlib.h>
 #include <string>
 #include <stdio.h>
 
@@ -397,10 +398,77 @@ static void Ctrl_BEL( Framebuffer *fb, Dispatcher *dispatch __attribute((unused)
 static Function func_Ctrl_BEL( CONTROL, "\x07", Ctrl_BEL );
 
 /* select graphics rendition -- e.g., bold, blinking, etc. */
+/* nearest color in the xterm 256-color palette's 6x6x6 cube or gray ramp */
+static int nearest_256_color( int r, int g, int b )
+{
+  const int levels[ 6 ] = { 0, 95, 135, 175, 215, 255 };
+  int cube[ 3 ] = { r, g, b };
+  int cube_dist = 0;
+  for ( int i = 0; i < 3; i++ ) {
+    int v = cube[ i ] > 255 ? 255 : cube[ i ];
+    int best = 0;
+    for ( int j = 1; j < 6; j++ ) {
+      if ( abs( levels[ j ] - v ) < abs( levels[ best ] - v ) ) {
+	best = j;
+      }
+    }
+    cube_dist += (levels[ best ] - v) * (levels[ best ] - v);
+    cube[ i ] = best;
+  }
+
+  int gray = ( r + g + b ) / 3;
+  int gray_step = gray < 8 ? 0 : ( gray > 238 ? 23 : (gray - 8 + 5) / 10 );
+  int gray_level = 8 + 10 * gray_step;
+  int gray_dist = (r - gray_level) * (r - gray_level) + (g - gray_level) * (g - gray_level)
+    + (b - gray_level) * (b - gray_level);
+
+  if ( gray_dist < cube_dist ) {
+    return 232 + gray_step;
+  }
+  return 16 + 36 * cube[ 0 ] + 6 * cube[ 1 ] + cube[ 2 ];
+}
+
 static void CSI_SGR( Framebuffer *fb, Dispatcher *dispatch )
 {
   for ( int i = 0; i < dispatch->param_count(); i++ ) {
     int rendition = dispatch->getparam( i, 0 );
+
+    /* ECMA-48 colon form: 38:5:Ps for a palette color, and
+       38:2:r:g:b or 38:2:colorspace:r:g:b for direct color, which
+       we approximate from the palette. */
+    if ( dispatch->is_subparam( i + 1 ) ) {
+      int end = i + 1;
+      while ( dispatch->is_subparam( end ) ) {
+	end++;
+      }
+      const int subparams = end - i - 1;
+
+      if ( rendition == 38 || rendition == 48 ) {
+	int color = -1;
+	if ( dispatch->getparam( i + 1, -1 ) == 5 && subparams >= 2 ) {
+	  color = dispatch->getparam( i + 2, 0 );
+	} else if ( dispatch->getparam( i + 1, -1 ) == 2 && subparams >= 4 ) {
+	  const int rgb = subparams == 4 ? i + 2 : i + 3;
+	  color = nearest_256_color( dispatch->getparam( rgb, 0 ),
+				     dispatch->getparam( rgb + 1, 0 ),
+				     dispatch->getparam( rgb + 2, 0 ) );
+	}
+	if ( color >= 0 ) {
+	  (rendition == 38) ?
+	    fb->ds.set_foreground_color( color ) :
+	    fb->ds.set_background_color( color );
+	}
+      } else if ( rendition == 4 && dispatch->getparam( i + 1, 0 ) == 0 ) {
+	fb->ds.add_rendition( 24 ); /* 4:0 is "not underlined" */
+      } else {
+	/* other styles (e.g. 4:3, curly underline) use their main value */
+	fb->ds.add_rendition( rendition );
+      }
+
+      i = end - 1;
+      continue;
+    }
+
     /* We need to special-case the handling of [34]8 ; 5 ; Ps,
        because Ps of 0 in that case does not mean reset to default, even
        though it means that otherwise (as usually renditions are applied
@@ -557,7 +625,7 @@ static void CSI_DECSTR( Framebuffer *fb, Dispatcher *dispatch __attribute((unuse
 static Function func_CSI_DECSTR( CSI, "!p", CSI_DECSTR );
 
 /* xterm uses an Operating System Command to set the window title */
-void Dispatcher::OSC_dispatch( const Parser::OSC_End *act __attribute((unused)), Framebuffer *fb )
+void Dispatcher::OSC_dispatch( const Parser::Action *act __attribute((unused)), Framebuffer *fb )
 {
   if ( OSC_string.size() >= 1 ) {
     long cmd_num = -1;
@@ -0,0 +1,63 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of portions of this program with the
+    OpenSSL library under certain conditions as described in each
+    individual source file, and distribute linked combinations including
+    the two.
+
+    You must obey the GNU General Public License in all respects for all
+    of the code used other than OpenSSL. If you modify file(s) with this
+    exception, you may extend this exception to your version of the
+    file(s), but you are not obligated to do so. If you do not wish to do
+    so, delete this exception statement from your version. If you delete
+    this exception statement from all source files in the program, then
+    also delete it here.
+*/
+
+#ifndef TERMINALWIDTH_HPP
+#define TERMINALWIDTH_HPP
+
+#include <wchar.h>
+#include <stdint.h>
+
+namespace Terminal {
+  /* Generated tables, see genwidthtable.pl */
+  static const unsigned int CHAR_WIDTH_INDEX_SIZE = 0x110000 >> 8;
+  static const unsigned int CHAR_WIDTH_BLOCK_BYTES = 256 / 4;
+
+  extern const unsigned char char_width_index[ CHAR_WIDTH_INDEX_SIZE ];
+  extern const unsigned char char_width_blocks[][ CHAR_WIDTH_BLOCK_BYTES ];
+
+  /* Number of cells the character occupies: like wcwidth(), but the
+     same on every platform and in every locale, so that client and
+     server always agree. */
+  inline int char_width( wchar_t ch )
+  {
+    const uint32_t c = ch;
+
+    if ( c >= 0x110000 ) {
+      return -1;
+    }
+
+    const unsigned char bits = char_width_blocks[ char_width_index[ c >> 8 ] ][ (c & 0xff) >> 2 ];
+    return static_cast<int>( (bits >> ( 2 * (c & 3) )) & 3 ) - 1;
+  }
+}
+
+#endif
@@ -0,0 +1,173 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of portions of this program with the
+    OpenSSL library under certain conditions as described in each
+    individual source file, and distribute linked combinations including
+    the two.
+
+    You must obey the GNU General Public License in all respects for all
+    of the code used other than OpenSSL. If you modify file(s) with this
+    exception, you may extend this exception to your version of the
+    file(s), but you are not obligated to do so. If you do not wish to do
+    so, delete this exception statement from your version. If you delete
+    this exception statement from all source files in the program, then
+    also delete it here.
+*/
+
+/* Tests the side table that holds combining sequences too long to
+   store in a cell: copies share an entry, entries are reused once no
+   cell holds them, and a cell that cannot grow keeps what it has. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "terminalframebuffer.h"
+#include "fatal_assert.h"
+
+using namespace Terminal;
+
+/* Stop filling the table after this many clusters.  It holds fewer. */
+static const unsigned int FILL_LIMIT = 1 << 20;
+
+/* A letter picked by n / FILL_LIMIT and five combining marks from
+   U+0300..U+030F picked by the hex digits of n, so distinct n below
+   26 * FILL_LIMIT give distinct clusters.  The fifth mark is what
+   takes the cluster out of the cell, unless it starts with a mark. */
+static std::wstring cluster( unsigned int n, bool fallback )
+{
+  std::wstring s;
+  if ( !fallback ) {
+    s.push_back( L'a' + n / FILL_LIMIT );
+  }
+  for ( int i = 0; i < 5; i++ ) {
+    s.push_back( 0x300 + ( n & 0xF ) );
+    n >>= 4;
+  }
+  return s;
+}
+
+/* What print_grapheme() gives for the first count characters */
+static std::string expected( const std::wstring &chars, size_t count, bool fallback )
+{
+  std::string s( fallback ? "\xC2\xA0" : "" );
+  for ( size_t i = 0; i < count; i++ ) {
+    Cell::append_to_str( s, chars[ i ] );
+  }
+  return s;
+}
+
+static std::string grapheme( const Cell &cell )
+{
+  std::string s;
+  cell.print_grapheme( s );
+  return s;
+}
+
+/* Puts the cluster for n in the cell and says whether all of it was
+   kept. */
+static bool make_cluster( Cell &cell, unsigned int n, bool fallback )
+{
+  const std::wstring chars = cluster( n, fallback );
+  cell.reset( 0 );
+  cell.set_fallback( fallback );
+  for ( size_t i = 0; i < chars.size(); i++ ) {
+    cell.append( chars[ i ] );
+  }
+  return grapheme( cell ) == expected( chars, chars.size(), fallback );
+}
+
+/* Fills the table with clusters from first on, held by cells, and
+   returns how many it took. */
+static unsigned int fill( std::vector<Cell> &held, unsigned int first )
+{
+  Cell cell( 0 );
+  for ( unsigned int n = first; n < first + FILL_LIMIT; n++ ) {
+    if ( !make_cluster( cell, n, false ) ) {
+      return n - first;
+    }
+    held.push_back( cell );
+  }
+  fprintf( stderr, "Side table never filled.\n" );
+  exit( 1 );
+}
+
+static void test_sharing( void )
+{
+  Cell a( 0 ), b( 0 );
+  fatal_assert( make_cluster( a, 1, false ) );
+  fatal_assert( make_cluster( b, 1, false ) );
+  fatal_assert( a == b );
+
+  /* A copy holds on to the entry after the original lets go. */
+  Cell copy( a );
+  a.clear();
+  b.clear();
+  fatal_assert( make_cluster( b, 2, false ) );
+  fatal_assert( grapheme( copy ) == expected( cluster( 1, false ), 6, false ) );
+  copy = b;
+  fatal_assert( copy == b );
+
+  /* A sequence is cut off before 256 bytes, whatever its length. */
+  Cell cell( 0 );
+  std::wstring chars( 1, L'a' );
+  chars.append( 200, 0x301 );
+  for ( size_t i = 0; i < chars.size(); i++ ) {
+    cell.append( chars[ i ] );
+  }
+  fatal_assert( grapheme( cell ) == expected( chars, 128, false ) );
+}
+
+static void test_reuse( void )
+{
+  std::vector<Cell> held;
+  const unsigned int capacity = fill( held, 0 );
+  fatal_assert( capacity > 1000 );
+
+  /* With the table full, a cell keeps its contents and flags, both
+     inline and in the table. */
+  Cell fallback( 0 );
+  fatal_assert( make_cluster( fallback, FILL_LIMIT, true ) );
+  fallback.append( 0x301 );
+  fatal_assert( fallback.get_fallback() );
+  fatal_assert( grapheme( fallback ) == expected( cluster( FILL_LIMIT, true ), 5, true ) );
+
+  Cell longest( held.back() );
+  longest.append( 0x301 );
+  fatal_assert( longest == held.back() );
+  fatal_assert( grapheme( longest ) == expected( cluster( capacity - 1, false ), 6, false ) );
+
+  /* Once no cell holds them, entries are reused; otherwise only
+     clusters from the first fill would fit. */
+  held.clear();
+  fatal_assert( fill( held, 2 * FILL_LIMIT ) == capacity - 1 );
+  held.clear();
+  longest.clear();
+  fatal_assert( fill( held, 3 * FILL_LIMIT ) == capacity );
+}
+
+int main( void )
+{
+  test_sharing();
+  test_reuse();
+  return 0;
+}
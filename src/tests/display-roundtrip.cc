@@ -0,0 +1,310 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of portions of this program with the
+    OpenSSL library under certain conditions as described in each
+    individual source file, and distribute linked combinations including
+    the two.
+
+    You must obey the GNU General Public License in all respects for all
+    of the code used other than OpenSSL. If you modify file(s) with this
+    exception, you may extend this exception to your version of the
+    file(s), but you are not obligated to do so. If you do not wish to do
+    so, delete this exception statement from your version. If you delete
+    this exception statement from all source files in the program, then
+    also delete it here.
+*/
+
+/* Tests that the bytes Display::new_frame sends, applied by our own
+   emulator on the client side, reproduce the new frame.  The cursor
+   motions, rendition changes and character repeats in them are
+   picked by cost, so this runs many random screen updates through
+   new_frame to cover the choices. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <string>
+#include <stdexcept>
+
+#include "completeterminal.h"
+#include "fatal_assert.h"
+#include "random-screen.h"
+
+using namespace Terminal;
+
+static std::string random_sgr( void )
+{
+  static const int codes[] = { 0, 1, 3, 4, 5, 7, 8, 22, 23, 24, 25, 27, 28,
+			       30, 31, 33, 37, 39, 40, 42, 44, 47, 49, 91, 96, 101, 104 };
+  char tmp[ 32 ];
+  switch ( rnd( 3 ) ) {
+  case 0:
+    snprintf( tmp, sizeof tmp, "\033[38;5;%dm", rnd( 256 ) );
+    return tmp;
+  case 1:
+    snprintf( tmp, sizeof tmp, "\033[48;5;%dm", rnd( 256 ) );
+    return tmp;
+  default:
+    return csi( codes[ rnd( sizeof codes / sizeof codes[ 0 ] ) ], 'm' );
+  }
+}
+
+/* Application output that changes the screen in a typical way. */
+static std::string random_update( void )
+{
+  std::string s;
+  for ( int ops = 1 + rnd( 8 ); ops > 0; ops-- ) {
+    switch ( rnd( 14 ) ) {
+    case 0:
+      s.append( csi( 1 + rnd( HEIGHT ), 1 + rnd( WIDTH ), 'H' ) );
+      break;
+    case 1:
+      s.append( csi( 1 + rnd( 10 ), "ABCD"[ rnd( 4 ) ] ) );
+      break;
+    case 2:
+      s.append( 1, "\r\n\b\t"[ rnd( 4 ) ] );
+      break;
+    case 3:
+      s.append( random_sgr() );
+      break;
+    case 4: case 5: case 6: case 7:
+      s.append( random_text( false ) );
+      break;
+    case 8:
+      s.append( csi( rnd( 3 ), "JK"[ rnd( 2 ) ] ) );
+      break;
+    case 9:
+      s.append( csi( 1 + rnd( 10 ), "X@P"[ rnd( 3 ) ] ) );
+      break;
+    case 10:
+      s.append( csi( 1 + rnd( 4 ), "LM"[ rnd( 2 ) ] ) );
+      break;
+    case 11: { /* scroll a region, and leave none set */
+      const int top = 1 + rnd( HEIGHT - 1 );
+      const int bottom = top + 1 + rnd( HEIGHT - top );
+      s.append( csi( top, bottom, 'r' ) );
+      if ( rnd( 2 ) ) {
+	s.append( csi( bottom, 'H' ) );
+	for ( int i = rnd( 4 ); i >= 0; i-- ) {
+	  s.append( "\n" + random_text( false ) );
+	}
+      } else {
+	s.append( csi( top, 'H' ) );
+	for ( int i = rnd( 4 ); i >= 0; i-- ) {
+	  s.append( "\033M" + random_text( false ) + "\r" );
+	}
+      }
+      s.append( "\033[r" );
+      break;
+    }
+    case 12: /* scroll the whole screen */
+      s.append( csi( HEIGHT, 'H' ) );
+      for ( int i = rnd( 4 ); i >= 0; i-- ) {
+	s.append( "\r\n" + random_text( false ) );
+      }
+      break;
+    default:
+      s.append( rnd( 2 ) ? "\033[?25l" : "\033[?25h" );
+      break;
+    }
+  }
+  return s;
+}
+
+/* Some states can't be drawn by any frame: a wide character shifted
+   into the last column, its right half written over or erased in
+   another color, or a wrap flag shifted into the middle of a row,
+   which the emulator allows, and a wrapped last row, which would
+   have to scroll away.  Applications don't produce them on purpose,
+   so clear the rows where random updates did. */
+static void clear_unreproducible_rows( Complete &terminal )
+{
+  const Framebuffer &fb = terminal.get_fb();
+  for ( int y = 0; y < HEIGHT; y++ ) {
+    const Row &row = *fb.get_row( y );
+    bool clear = ( ( y == HEIGHT - 1 ) && row.get_wrap() ) || row.cells.back().get_wide();
+    for ( int x = 0; x + 1 < WIDTH && !clear; x++ ) {
+      const Cell &right = row.cells[ x + 1 ];
+      const Cell blank( row.cells[ x ].get_renditions().background_color );
+      clear = row.cells[ x ].get_wrap()
+	|| ( row.cells[ x ].get_wide()
+	     && ( !right.empty() || !( right.get_renditions() == blank.get_renditions() ) ) );
+    }
+    if ( clear ) {
+      terminal.act( "\0337" + csi( y + 1, 'H' ) + "\033[2K\0338" );
+    }
+  }
+}
+
+/* Our emulator doesn't implement REP, so expand it as a terminal
+   would, by repeating the character sent just before it. */
+static int reps_expanded = 0;
+
+static std::string expand_rep( const std::string &frame )
+{
+  std::string out;
+  size_t i = 0;
+  while ( i < frame.size() ) {
+    if ( frame.compare( i, 2, "\033[" ) == 0 ) {
+      size_t j = i + 2;
+      while ( j < frame.size() && isdigit( static_cast<unsigned char>( frame[ j ] ) ) ) {
+	j++;
+      }
+      if ( j > i + 2 && j < frame.size() && frame[ j ] == 'b' ) {
+	fatal_assert( !out.empty() );
+	size_t start = out.size() - 1;
+	while ( start > 0 && ( out[ start ] & 0xC0 ) == 0x80 ) {
+	  start--;
+	}
+	const std::string ch( out, start );
+	for ( int n = atoi( frame.c_str() + i + 2 ); n > 0; n-- ) {
+	  out.append( ch );
+	}
+	reps_expanded++;
+	i = j + 1;
+	continue;
+      }
+    }
+    out.push_back( frame[ i ] );
+    i++;
+  }
+  return out;
+}
+
+/* Send the frame taking before to after to the client, whose
+   terminal must then match after.  Like the server's round-trip
+   check, this takes an empty cell and a space to be the same. */
+static void check_frame( const Display &display, bool initialized,
+			 const Complete &before, const Complete &after,
+			 Complete &client )
+{
+  const std::string frame = display.new_frame( initialized, before.get_fb(), after.get_fb() );
+  client.act( expand_rep( frame ) );
+
+  const DrawState &want = after.get_fb().ds, &got = client.get_fb().ds;
+  if ( after.compare( client )
+       || !( want.get_renditions() == got.get_renditions() )
+       || want.cursor_visible != got.cursor_visible ) {
+    fprintf( stderr, "Frame (%s) did not reproduce the new state:\n",
+	     initialized ? "update" : "redraw" );
+    for ( size_t i = 0; i < frame.size(); i++ ) {
+      const unsigned char c = frame[ i ];
+      if ( c < 0x20 || c >= 0x7f ) {
+	fprintf( stderr, "\\%03o", c );
+      } else {
+	fputc( c, stderr );
+      }
+    }
+    fputc( '\n', stderr );
+    exit( 1 );
+  }
+}
+
+static void test_frames( const Display &display, const char *name )
+{
+  Complete terminal( WIDTH, HEIGHT ), client( WIDTH, HEIGHT );
+  const int FRAMES = 20000;
+
+  for ( int i = 0; i < FRAMES; i++ ) {
+    const Complete before( terminal );
+    /* sometimes several updates arrive between frames */
+    for ( int j = rnd( 3 ); j >= 0; j-- ) {
+      terminal.act( random_update() );
+    }
+    clear_unreproducible_rows( terminal );
+    if ( i % 100 == 0 ) {
+      Complete redrawn( client );
+      check_frame( display, false, before, terminal, redrawn );
+    }
+    check_frame( display, true, before, terminal, client );
+  }
+  if ( verbose ) {
+    printf( "%s frames PASSED\n", name );
+  }
+}
+
+/* The client's display uses the terminal's capabilities, which may
+   include REP.  Try one that does, if it is installed. */
+static void test_rep_frames( void )
+{
+  setenv( "TERM", "xterm-256color", 1 );
+  try {
+    const Display display( true );
+    test_frames( display, "xterm-256color" );
+  } catch ( const std::exception &e ) {
+    if ( verbose ) {
+      printf( "xterm-256color frames SKIPPED: %s\n", e.what() );
+    }
+    return;
+  }
+  /* the runs of repeated characters should have used it */
+  fatal_assert( reps_expanded > 0 );
+}
+
+static Renditions random_renditions( void )
+{
+  Renditions r( 0 );
+  for ( int i = rnd( 6 ); i >= 0; i-- ) {
+    switch ( rnd( 4 ) ) {
+    case 0:
+      r.set_foreground_color( rnd( 256 ) );
+      break;
+    case 1:
+      r.set_background_color( rnd( 256 ) );
+      break;
+    default:
+      r.set_rendition( 1 + rnd( 8 ) );
+      break;
+    }
+  }
+  return r;
+}
+
+/* Renditions::sgr( from ) must take the terminal from one rendition
+   to the other, and never take more bytes than starting over. */
+static void test_renditions( void )
+{
+  for ( int i = 0; i < 100000; i++ ) {
+    const Renditions from = random_renditions(), to = random_renditions();
+    Complete terminal( 10, 2 );
+    terminal.act( from.sgr() );
+    fatal_assert( terminal.get_fb().ds.get_renditions() == from );
+    const std::string change = to.sgr( from );
+    fatal_assert( change.size() <= to.sgr().size() );
+    terminal.act( change );
+    fatal_assert( terminal.get_fb().ds.get_renditions() == to );
+  }
+  if ( verbose ) {
+    printf( "renditions PASSED\n" );
+  }
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc >= 2 && strcmp( argv[ 1 ], "-v" ) == 0 ) {
+    verbose = true;
+  }
+
+  test_renditions();
+  test_frames( Display( false ), "default" );
+  test_rep_frames();
+  return 0;
+}
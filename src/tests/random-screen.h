@@ -0,0 +1,107 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of portions of this program with the
+    OpenSSL library under certain conditions as described in each
+    individual source file, and distribute linked combinations including
+    the two.
+
+    You must obey the GNU General Public License in all respects for all
+    of the code used other than OpenSSL. If you modify file(s) with this
+    exception, you may extend this exception to your version of the
+    file(s), but you are not obligated to do so. If you do not wish to do
+    so, delete this exception statement from your version. If you delete
+    this exception statement from all source files in the program, then
+    also delete it here.
+*/
+
+/* Random screen updates for the tests that run the terminal through
+   many of them.  The sequence is fixed, so that failures can be
+   reproduced. */
+
+#ifndef RANDOM_SCREEN_HPP
+#define RANDOM_SCREEN_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+static bool verbose = false;
+
+static const int WIDTH = 80;
+static const int HEIGHT = 24;
+
+static uint32_t rng_state = 1;
+
+static inline int rnd( int n )
+{
+  rng_state = rng_state * 1103515245 + 12345;
+  return ( rng_state >> 8 ) % n;
+}
+
+static inline std::string csi( int a, char final )
+{
+  char tmp[ 32 ];
+  snprintf( tmp, sizeof tmp, "\033[%d%c", a, final );
+  return tmp;
+}
+
+static inline std::string csi( int a, int b, char final )
+{
+  char tmp[ 32 ];
+  snprintf( tmp, sizeof tmp, "\033[%d;%d%c", a, b, final );
+  return tmp;
+}
+
+/* A run of one character, spaces, a word, or wide or combining
+   characters.  ASCII-only text is at most 15 columns wide, so that
+   callers can keep it from wrapping. */
+static inline std::string random_text( bool ascii )
+{
+  std::string s;
+  int kind = rnd( 6 );
+  if ( ascii && ( kind == 1 || kind == 2 ) ) {
+    kind = 5;
+  }
+  switch ( kind ) {
+  case 0: /* a run of one character */
+    s.append( 2 + rnd( ascii ? 14 : 30 ), "-=x #"[ rnd( 5 ) ] );
+    break;
+  case 1: /* wide characters */
+    for ( int i = rnd( 6 ); i >= 0; i-- ) {
+      s.append( rnd( 2 ) ? "\xe4\xb8\xad" : "\xef\xbc\xa1" );
+    }
+    break;
+  case 2: /* combining characters */
+    for ( int i = rnd( 4 ); i >= 0; i-- ) {
+      s.append( "e\xcc\x81 " );
+    }
+    break;
+  case 3:
+    s.append( 1 + rnd( 8 ), ' ' );
+    break;
+  default:
+    for ( int i = rnd( ascii ? 15 : 20 ); i >= 0; i-- ) {
+      s.push_back( 'a' + rnd( 26 ) );
+    }
+    break;
+  }
+  return s;
+}
+
+#endif
@@ -0,0 +1,433 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of portions of this program with the
+    OpenSSL library under certain conditions as described in each
+    individual source file, and distribute linked combinations including
+    the two.
+
+    You must obey the GNU General Public License in all respects for all
+    of the code used other than OpenSSL. If you modify file(s) with this
+    exception, you may extend this exception to your version of the
+    file(s), but you are not obligated to do so. If you do not wish to do
+    so, delete this exception statement from your version. If you delete
+    this exception statement from all source files in the program, then
+    also delete it here.
+*/
+
+/* Tests the shortcuts taken in keeping and sending terminal states:
+   diffs against older kept states, with and without interned rows,
+   equality by version and the sender's diff cache, and the sender
+   copying the state it follows only when something is due. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/select.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "completeterminal.h"
+#include "fatal_assert.h"
+#include "network.h"
+#include "random-screen.h"
+#include "timestamp.h"
+#include "transportfragment.h"
+#include "transportsender-impl.h"
+
+using namespace Terminal;
+
+/* Text that never reaches the last column, so no row wraps.
+   Repeated lines are likely, so that interning finds shared rows. */
+static std::string random_line( void )
+{
+  static const char *const lines[] = { "~", "----------", "$ ls", "    " };
+  return rnd( 3 ) ? random_text( true ) : lines[ rnd( 4 ) ];
+}
+
+static std::string random_update( void )
+{
+  std::string s;
+  for ( int ops = 1 + rnd( 6 ); ops > 0; ops-- ) {
+    switch ( rnd( 9 ) ) {
+    case 0: case 1: case 2:
+      s.append( csi( 1 + rnd( HEIGHT ), 1 + rnd( WIDTH - 20 ), 'H' ) + random_line() );
+      break;
+    case 3: {
+      static const int renditions[] = { 0, 1, 4, 7, 31, 44 };
+      s.append( csi( renditions[ rnd( 6 ) ], 'm' ) );
+      break;
+    }
+    case 4:
+      s.append( csi( 1 + rnd( HEIGHT ), 1 + rnd( WIDTH - 20 ), 'H' ) + csi( rnd( 3 ), "JK"[ rnd( 2 ) ] ) );
+      break;
+    case 5:
+      s.append( csi( 1 + rnd( HEIGHT ), 1 + rnd( WIDTH - 20 ), 'H' ) + csi( 1 + rnd( 10 ), "X@P"[ rnd( 3 ) ] ) );
+      break;
+    case 6:
+      s.append( csi( 1 + rnd( HEIGHT ), 1, 'H' ) + csi( 1 + rnd( 4 ), "LM"[ rnd( 2 ) ] ) );
+      break;
+    case 7: { /* scroll a region, and leave none set */
+      const int top = 1 + rnd( HEIGHT - 1 );
+      const int bottom = top + 1 + rnd( HEIGHT - top );
+      s.append( csi( top, bottom, 'r' ) + csi( bottom, 'H' ) );
+      for ( int i = rnd( 3 ); i >= 0; i-- ) {
+	s.append( "\n" + random_line() + "\r" );
+      }
+      s.append( "\033[r" );
+      break;
+    }
+    default: /* scroll the whole screen */
+      s.append( csi( HEIGHT, 'H' ) );
+      for ( int i = rnd( 3 ); i >= 0; i-- ) {
+	s.append( "\r\n" + random_line() );
+      }
+      break;
+    }
+  }
+  return s;
+}
+
+/* The diff from source must take a copy of source to target. */
+static void check_diff( const Complete &target, const Complete &source, const std::string &diff )
+{
+  Complete client( source );
+  client.apply_string( diff );
+  if ( target.compare( client ) ) {
+    fprintf( stderr, "Diff did not reproduce the target state.\n" );
+    exit( 1 );
+  }
+}
+
+typedef std::pair< Complete, bool > kept_state; /* and whether it is interned */
+typedef std::map< std::pair< uint64_t, uint64_t >, std::string > diff_cache;
+
+/* Keeps a few states, as the sender does, and diffs the terminal
+   against each of them, some several updates old.  Like the sender,
+   it also remembers diffs between interned states by version, and
+   checks that they are what a fresh diff would give. */
+static void test_older_states( void )
+{
+  Complete terminal( WIDTH, HEIGHT );
+  std::deque< kept_state > kept( 1, kept_state( terminal, false ) );
+  diff_cache cache;
+  unsigned int cache_hits = 0;
+  const int STEPS = 5000;
+  const size_t KEPT = 6;
+
+  for ( int i = 0; i < STEPS; i++ ) {
+    const uint64_t old_version = terminal.get_version();
+    for ( int j = rnd( 3 ); j >= 0; j-- ) {
+      terminal.act( random_update() );
+    }
+    fatal_assert( terminal.get_version() != old_version );
+
+    const kept_state &source = kept[ rnd( kept.size() ) ];
+    check_diff( terminal, source.first, terminal.diff_from( source.first ) );
+
+    /* A copy keeps the version, and so does interning. */
+    kept.push_back( kept_state( terminal, false ) );
+    Complete &copy = kept.back().first;
+    fatal_assert( copy.get_version() == terminal.get_version() );
+    fatal_assert( copy == terminal );
+    if ( rnd( 2 ) ) {
+      copy.intern();
+      kept.back().second = true;
+      fatal_assert( copy.get_version() == terminal.get_version() );
+    }
+    fatal_assert( !copy.compare( terminal ) );
+    if ( kept.size() > KEPT ) {
+      kept.pop_front();
+    }
+
+    const kept_state &target = kept[ rnd( kept.size() ) ], &older = kept[ rnd( kept.size() ) ];
+    if ( target.second && older.second ) {
+      const std::string diff = target.first.diff_from( older.first );
+      check_diff( target.first, older.first, diff );
+      const std::pair< uint64_t, uint64_t > key( target.first.get_version(), older.first.get_version() );
+      diff_cache::const_iterator cached = cache.find( key );
+      if ( cached == cache.end() ) {
+	cache[ key ] = diff;
+      } else {
+	fatal_assert( cached->second == diff );
+	cache_hits++;
+      }
+    }
+  }
+  fatal_assert( cache_hits > 0 );
+  if ( verbose ) {
+    printf( "older states PASSED (%u cached diffs reused)\n", cache_hits );
+  }
+}
+
+/* A state for the sender that counts how often it is copied into
+   current_state and diffed.  A diff names both states' text, so a
+   diff used for the wrong pair shows. */
+class Probe {
+private:
+  std::string text;
+  uint64_t version;
+
+  static uint64_t new_version( void )
+  {
+    static uint64_t version_counter = 0;
+    return ++version_counter;
+  }
+
+public:
+  static unsigned int pulls, diffs;
+
+  explicit Probe( const std::string &s_text ) : text( s_text ), version( new_version() ) {}
+  Probe( const Probe &x ) : text( x.text ), version( x.version ) {}
+  Probe &operator=( const Probe &x )
+  {
+    pulls++;
+    text = x.text;
+    version = x.version;
+    return *this;
+  }
+
+  void set( const std::string &s_text ) { text = s_text; version = new_version(); }
+  const std::string &get_text( void ) const { return text; }
+  uint64_t get_version( void ) const { return version; }
+
+  /* interface for Network::TransportSender */
+  void reset_input( void ) {}
+  void subtract( const Probe * ) const {}
+  void intern( void ) {}
+  std::string diff_from( const Probe &existing ) const
+  {
+    diffs++;
+    return text == existing.text ? std::string() : existing.text + '>' + text;
+  }
+  std::string init_diff( void ) const { return diff_from( Probe( std::string() ) ); }
+  void apply_string( const std::string &diff )
+  {
+    if ( !diff.empty() ) {
+      text = diff.substr( diff.find( '>' ) + 1 );
+      version = new_version();
+    }
+  }
+  bool operator==( const Probe &x ) const { return version == x.version || text == x.text; }
+  bool compare( const Probe &x ) const { return text != x.text; }
+};
+
+unsigned int Probe::pulls = 0, Probe::diffs = 0;
+
+/* The other end of the connection, which keeps every state it is sent. */
+class Receiver {
+private:
+  Network::Connection connection;
+  Network::FragmentAssembly fragments;
+  std::map< uint64_t, std::string > states;
+
+public:
+  Receiver( const std::string &initial_text )
+    : connection( "127.0.0.1", NULL ), fragments(), states()
+  {
+    states[ 0 ] = initial_text;
+  }
+
+  Network::Connection &get_connection( void ) { return connection; }
+  const std::string &state( uint64_t num ) { return states[ num ]; }
+
+  /* Runs the sender until an instruction arrives, and checks that
+     its diff starts from the state it names. */
+  Instruction next( Network::TransportSender<Probe> &sender )
+  {
+    const uint64_t deadline = Network::timestamp() + 5000;
+    Instruction inst;
+    while ( Network::timestamp() < deadline ) {
+      if ( poll( sender, inst ) ) {
+	return inst;
+      }
+    }
+    fprintf( stderr, "Timed out waiting for the sender.\n" );
+    exit( 1 );
+  }
+
+  /* Runs the sender for a while, during which it must send nothing. */
+  void idle( Network::TransportSender<Probe> &sender, uint64_t ms )
+  {
+    const uint64_t deadline = Network::timestamp() + ms;
+    Instruction inst;
+    while ( Network::timestamp() < deadline ) {
+      fatal_assert( !poll( sender, inst ) );
+    }
+  }
+
+private:
+  /* Ticks the sender once and waits briefly for an instruction. */
+  bool poll( Network::TransportSender<Probe> &sender, Instruction &inst )
+  {
+    sender.tick();
+
+    fd_set fds;
+    FD_ZERO( &fds );
+    const std::vector< int > socks = connection.fds();
+    int max_fd = -1;
+    for ( std::vector< int >::const_iterator i = socks.begin(); i != socks.end(); i++ ) {
+      FD_SET( *i, &fds );
+      max_fd = std::max( max_fd, *i );
+    }
+    struct timeval tv = { 0, 1000 * std::min( sender.wait_time(), 10 ) };
+    fatal_assert( select( max_fd + 1, &fds, NULL, NULL, &tv ) >= 0 );
+    freeze_timestamp();
+    if ( !select_ready( fds, socks ) ) {
+      return false;
+    }
+    Network::Fragment fragment( connection.recv() );
+    if ( !fragments.add_fragment( fragment ) ) {
+      return false;
+    }
+    inst = fragments.get_assembly();
+    fatal_assert( states.count( inst.old_num() ) );
+    const std::string &old_text = states[ inst.old_num() ];
+    if ( inst.diff().empty() ) {
+      states[ inst.new_num() ] = old_text;
+    } else {
+      const size_t split = inst.diff().find( '>' );
+      fatal_assert( inst.diff().substr( 0, split ) == old_text );
+      states[ inst.new_num() ] = inst.diff().substr( split + 1 );
+    }
+    return true;
+  }
+
+  static bool select_ready( fd_set &fds, const std::vector< int > &socks )
+  {
+    for ( std::vector< int >::const_iterator i = socks.begin(); i != socks.end(); i++ ) {
+      if ( FD_ISSET( *i, &fds ) ) {
+	return true;
+      }
+    }
+    return false;
+  }
+};
+
+static void test_sender( void )
+{
+  Receiver receiver( "initial" );
+  Probe initial( "initial" );
+  Network::Connection link( receiver.get_connection().get_key().c_str(), "127.0.0.1",
+			    receiver.get_connection().port().c_str() );
+  Network::TransportSender<Probe> sender( &link, initial );
+
+  Probe source( initial );
+  sender.set_current_state_source( &source );
+  sender.remote_heard( Network::timestamp() );
+
+  /* Changes alone copy nothing... */
+  for ( int i = 0; i < 100; i++ ) {
+    char text[ 16 ];
+    snprintf( text, sizeof text, "change %d", i );
+    source.set( text );
+    sender.wait_time();
+  }
+  fatal_assert( Probe::pulls == 0 );
+
+  /* ...until a send is due, which takes the latest. */
+  Instruction first = receiver.next( sender );
+  fatal_assert( first.old_num() == 0 && first.new_num() == 1 );
+  fatal_assert( receiver.state( 1 ) == "change 99" );
+  fatal_assert( Probe::pulls == 1 );
+
+  /* With no ack, the same diff is sent again from the cache, and is
+     what a fresh diff_from gives. */
+  const unsigned int diffs = Probe::diffs;
+  Instruction resent = receiver.next( sender );
+  fatal_assert( resent.old_num() == 0 && resent.new_num() == 1 );
+  fatal_assert( resent.diff() == first.diff() );
+  fatal_assert( Probe::diffs == diffs );
+  fatal_assert( resent.diff() == Probe( source ).diff_from( initial ) );
+  fatal_assert( Probe::pulls == 1 );
+
+  /* Shutdown freezes the state last set, whatever follows. */
+  source.set( "final" );
+  sender.start_shutdown();
+  fatal_assert( Probe::pulls == 2 );
+  source.set( "after shutdown" );
+  Instruction last;
+  do {
+    last = receiver.next( sender );
+  } while ( last.new_num() != uint64_t( -1 ) );
+  fatal_assert( receiver.state( uint64_t( -1 ) ) == "final" );
+  fatal_assert( Probe::pulls == 2 );
+
+  if ( verbose ) {
+    printf( "sender PASSED\n" );
+  }
+}
+
+/* A source can get a new version without changing, as from an
+   escape sequence that does nothing.  Once the sender has copied it
+   and found it equal to what was sent, the next real change must
+   still wait SEND_MINDELAY for more to follow. */
+static void test_touched_source( void )
+{
+  const int DELAY = 300;
+  Receiver receiver( "initial" );
+  Probe initial( "initial" );
+  Network::Connection link( receiver.get_connection().get_key().c_str(), "127.0.0.1",
+			    receiver.get_connection().port().c_str() );
+  Network::TransportSender<Probe> sender( &link, initial );
+  sender.set_send_delay( DELAY );
+
+  Probe source( initial );
+  sender.set_current_state_source( &source );
+  sender.remote_heard( Network::timestamp() );
+
+  source.set( "one" );
+  Instruction first = receiver.next( sender );
+  fatal_assert( receiver.state( first.new_num() ) == "one" );
+  sender.process_acknowledgment_through( first.new_num() );
+
+  const unsigned int pulls = Probe::pulls;
+  source.set( "one" );
+  receiver.idle( sender, 2 * DELAY );
+  fatal_assert( Probe::pulls == pulls + 1 );
+
+  freeze_timestamp();
+  const uint64_t changed = Network::timestamp();
+  source.set( "two" );
+  Instruction second = receiver.next( sender );
+  fatal_assert( receiver.state( second.new_num() ) == "two" );
+  fatal_assert( Network::timestamp() >= changed + DELAY );
+
+  if ( verbose ) {
+    printf( "touched source PASSED\n" );
+  }
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc >= 2 && strcmp( argv[ 1 ], "-v" ) == 0 ) {
+    verbose = true;
+  }
+
+  /* as in mosh-server */
+  RowPool::set_interning( true );
+
+  test_older_states();
+  test_sender();
+  test_touched_source();
+  return 0;
+}